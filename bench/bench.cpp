@@ -0,0 +1,384 @@
+#include "SDL.h"
+#undef main
+
+#include "imgui.h"
+#include "imgui_sdl.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Renders scripted ImGui workloads with ImGuiSDL into an offscreen software renderer and prints how long ImGuiSDL::Render took, as JSON.
+// Every frame is built from nothing but the frame number, so two runs of the same build render exactly the same draw data.
+
+namespace
+{
+	struct Options
+	{
+		int Width = 1280, Height = 720;
+		int WarmupFrames = 10, Frames = 300;
+		int Threads = 1;
+		ImGuiSDL::RenderMode Mode = ImGuiSDL::RenderMode::Rasterizer;
+		// Draws into the pixels of the surface with ImGuiSDL::Render and a framebuffer, without going through the renderer at all.
+		bool UseFramebuffer = false;
+		std::string Workload;
+	};
+
+	struct Workload
+	{
+		const char* Name;
+		void (*BuildFrame)(int frame);
+		// Cold workloads start every frame with empty caches, so they measure the cost of rasterizing everything from scratch.
+		bool IsCold;
+		// Resizing workloads change the size of the target every frame, between half and all of the configured size. The renderer sees this
+		// as a new viewport, like it does when a window is resized, and the framebuffer as a smaller one in the same pixels.
+		bool IsResizing;
+	};
+
+	ImVec2 DisplaySize()
+	{
+		return ImGui::GetIO().DisplaySize;
+	}
+
+	void BuildTextLog(int frame)
+	{
+		ImGui::SetNextWindowPos(ImVec2(0, 0));
+		ImGui::SetNextWindowSize(DisplaySize());
+		ImGui::Begin("Log");
+
+		ImGui::BeginChild("Scrolling");
+		for (int line = 0; line < 2000; line++)
+		{
+			ImGui::Text("[%05d] worker %d finished job %d in %d.%03d ms", line, line % 7, line * 31 % 1000, line % 13, line * 17 % 1000);
+		}
+		ImGui::SetScrollY(static_cast<float>(frame * 7 % 20000));
+		ImGui::EndChild();
+
+		ImGui::End();
+	}
+
+	void BuildTable(int frame)
+	{
+		ImGui::SetNextWindowPos(ImVec2(0, 0));
+		ImGui::SetNextWindowSize(DisplaySize());
+		ImGui::Begin("Table");
+
+		ImGui::Columns(6, "Columns");
+		for (int row = 0; row < 300; row++)
+		{
+			// A few cells change every frame, like a table of live values would.
+			ImGui::Text("%d", row);
+			ImGui::NextColumn();
+			ImGui::Text("Entity %d", row * 13 % 997);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f", (row * 37 % 1000) / 10.0f);
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", ((row + frame) * 53 % 1000) / 100.0f);
+			ImGui::NextColumn();
+			bool enabled = (row + frame / 30) % 3 == 0;
+			ImGui::Checkbox(("##enabled" + std::to_string(row)).c_str(), &enabled);
+			ImGui::NextColumn();
+			ImGui::Button(("Edit##" + std::to_string(row)).c_str());
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+
+		ImGui::End();
+	}
+
+	void BuildManyWindows(int frame)
+	{
+		static constexpr int columns = 8, rows = 6;
+		const float width = DisplaySize().x / columns;
+		const float height = DisplaySize().y / rows;
+
+		for (int i = 0; i < columns * rows; i++)
+		{
+			const std::string name = "Window " + std::to_string(i);
+			ImGui::SetNextWindowPos(ImVec2((i % columns) * width, (i / columns) * height));
+			ImGui::SetNextWindowSize(ImVec2(width - 4, height - 4));
+			ImGui::Begin(name.c_str());
+
+			bool checked = (i + frame / 20) % 2 == 0;
+			ImGui::Checkbox("Enabled", &checked);
+			ImGui::Button("Apply");
+			ImGui::SameLine();
+			ImGui::Button("Reset");
+
+			float values[16];
+			for (int v = 0; v < 16; v++) values[v] = static_cast<float>((v * 7 + i * 3 + frame) % 16);
+			ImGui::PlotLines("##values", values, 16);
+
+			ImGui::End();
+		}
+	}
+
+	void BuildDemo(int)
+	{
+		ImGui::SetNextWindowPos(ImVec2(10, 10));
+		ImGui::ShowDemoWindow();
+
+		float color[4] = { 0.4f, 0.7f, 0.2f, 1.0f };
+		ImGui::SetNextWindowPos(ImVec2(600, 10));
+		ImGui::Begin("Color");
+		ImGui::ColorPicker4("##picker", color);
+		ImGui::End();
+	}
+
+	const Workload Workloads[] = {
+		{ "text_log", &BuildTextLog, false, false },
+		{ "table", &BuildTable, false, false },
+		{ "many_windows", &BuildManyWindows, false, false },
+		{ "steady_state", &BuildDemo, false, false },
+		{ "cold_cache", &BuildDemo, true, false },
+		{ "resize_storm", &BuildManyWindows, false, true }
+	};
+
+	bool IsWorkload(const std::string& name)
+	{
+		for (const Workload& workload : Workloads)
+		{
+			if (name == workload.Name) return true;
+		}
+		return false;
+	}
+
+	void PrintWorkloads()
+	{
+		std::fprintf(stderr, "The workloads are:");
+		for (const Workload& workload : Workloads) std::fprintf(stderr, " %s", workload.Name);
+		std::fprintf(stderr, "\n");
+	}
+
+	double Percentile(std::vector<double> values, double percentile)
+	{
+		if (values.empty()) return 0.0;
+
+		std::sort(values.begin(), values.end());
+		const std::size_t index = static_cast<std::size_t>(percentile / 100.0 * (values.size() - 1) + 0.5);
+		return values[index];
+	}
+
+	double HitRate(long long hits, long long misses)
+	{
+		return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 1.0;
+	}
+
+	// Sums of the counters over the measured frames.
+	struct Totals
+	{
+		long long SDLCalls = 0, ElidedSDLCalls = 0, RasterizedPixels = 0;
+		long long UniformColorHits = 0, UniformColorMisses = 0;
+		long long GenericHits = 0, GenericMisses = 0;
+		long long PolygonHits = 0, PolygonMisses = 0;
+		double ClassificationTime = 0.0;
+
+		void Add(const ImGuiSDL::FrameStats& stats)
+		{
+			SDLCalls += stats.SDLCalls;
+			ElidedSDLCalls += stats.ElidedSDLCalls;
+			RasterizedPixels += stats.RasterizedPixels;
+			UniformColorHits += stats.UniformColorTriangleCache.Hits;
+			UniformColorMisses += stats.UniformColorTriangleCache.Misses;
+			GenericHits += stats.GenericTriangleCache.Hits;
+			GenericMisses += stats.GenericTriangleCache.Misses;
+			PolygonHits += stats.PolygonCache.Hits;
+			PolygonMisses += stats.PolygonCache.Misses;
+			ClassificationTime += stats.ClassificationTime;
+		}
+	};
+
+	// Returns the context that renders into the framebuffer, if the options ask for one.
+	ImGuiSDL::Context* InitializeRenderer(SDL_Renderer* renderer, const Options& options)
+	{
+		ImGuiSDL::Initialize(renderer, options.Width, options.Height);
+		ImGuiSDL::SetRenderMode(options.Mode);
+		ImGuiSDL::SetRasterizerThreadCount(options.Threads);
+
+		return options.UseFramebuffer ? ImGuiSDL::CreateContext(nullptr, ImGui::GetIO().Fonts) : nullptr;
+	}
+
+	void DeinitializeRenderer(ImGuiSDL::Context* framebufferContext)
+	{
+		ImGuiSDL::DestroyContext(framebufferContext);
+		ImGuiSDL::Deinitialize();
+	}
+
+	void RunWorkload(const Workload& workload, SDL_Renderer* renderer, SDL_Surface* surface, const Options& options, bool isFirst)
+	{
+		ImGui::CreateContext();
+		ImGuiIO& io = ImGui::GetIO();
+		io.IniFilename = nullptr;
+		io.DeltaTime = 1.0f / 60.0f;
+
+		ImGuiSDL::Context* framebufferContext = InitializeRenderer(renderer, options);
+
+		ImGuiSDL::Framebuffer framebuffer;
+		framebuffer.Pixels = surface->pixels;
+		framebuffer.Pitch = surface->pitch;
+		framebuffer.Width = surface->w;
+		framebuffer.Height = surface->h;
+
+		std::vector<double> times;
+		Totals totals;
+
+		const int warmupFrames = workload.IsCold ? 0 : options.WarmupFrames;
+		for (int frame = 0; frame < warmupFrames + options.Frames; frame++)
+		{
+			if (workload.IsCold && frame > 0)
+			{
+				DeinitializeRenderer(framebufferContext);
+				framebufferContext = InitializeRenderer(renderer, options);
+			}
+
+			const float scale = workload.IsResizing ? 0.5f + 0.5f * ((frame * 37) % 101) / 100.0f : 1.0f;
+			const SDL_Rect target = { 0, 0, static_cast<int>(options.Width * scale), static_cast<int>(options.Height * scale) };
+			io.DisplaySize = ImVec2(static_cast<float>(target.w), static_cast<float>(target.h));
+			framebuffer.Width = target.w;
+			framebuffer.Height = target.h;
+			SDL_RenderSetViewport(renderer, &target);
+
+			ImGui::NewFrame();
+			workload.BuildFrame(frame);
+			ImGui::Render();
+
+			// The renderer may hold back its clear until it's flushed, which would wipe out whatever went into the framebuffer.
+			if (framebufferContext)
+			{
+				SDL_FillRect(surface, nullptr, SDL_MapRGBA(surface->format, 114, 144, 154, 255));
+			}
+			else
+			{
+				SDL_SetRenderDrawColor(renderer, 114, 144, 154, 255);
+				SDL_RenderClear(renderer);
+			}
+
+			const Uint64 start = SDL_GetPerformanceCounter();
+			if (framebufferContext) ImGuiSDL::Render(framebufferContext, ImGui::GetDrawData(), framebuffer);
+			else ImGuiSDL::Render(ImGui::GetDrawData());
+			const Uint64 end = SDL_GetPerformanceCounter();
+
+			if (frame < warmupFrames) continue;
+
+			times.push_back(static_cast<double>(end - start) * 1000.0 / SDL_GetPerformanceFrequency());
+			totals.Add(framebufferContext ? ImGuiSDL::GetFrameStats(framebufferContext) : ImGuiSDL::GetFrameStats());
+		}
+
+		DeinitializeRenderer(framebufferContext);
+		ImGui::DestroyContext();
+		SDL_RenderSetViewport(renderer, nullptr);
+
+		double sum = 0.0;
+		for (double time : times) sum += time;
+		const double frames = static_cast<double>(std::max<std::size_t>(times.size(), 1));
+
+		std::printf("%s\n    {\"workload\": \"%s\", \"frames\": %d, \"ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}, "
+			"\"classification_ms\": %.4f, \"sdl_calls_per_frame\": %.1f, \"elided_sdl_calls_per_frame\": %.1f, \"rasterized_pixels_per_frame\": %.1f, "
+			"\"hit_rate\": {\"uniform_color_triangles\": %.4f, \"generic_triangles\": %.4f, \"polygons\": %.4f}}",
+			isFirst ? "" : ",", workload.Name, options.Frames,
+			sum / frames, Percentile(times, 50.0), Percentile(times, 90.0), Percentile(times, 99.0), Percentile(times, 100.0),
+			totals.ClassificationTime / frames, totals.SDLCalls / frames, totals.ElidedSDLCalls / frames, totals.RasterizedPixels / frames,
+			HitRate(totals.UniformColorHits, totals.UniformColorMisses),
+			HitRate(totals.GenericHits, totals.GenericMisses),
+			HitRate(totals.PolygonHits, totals.PolygonMisses));
+	}
+
+	const char* ModeName(const Options& options)
+	{
+		if (options.UseFramebuffer) return "framebuffer";
+
+		switch (options.Mode)
+		{
+		case ImGuiSDL::RenderMode::Automatic: return "automatic";
+		case ImGuiSDL::RenderMode::Geometry: return "geometry";
+		case ImGuiSDL::RenderMode::Rasterizer: return "rasterizer";
+		}
+		return "";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string argument = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+			if (!value)
+			{
+				std::fprintf(stderr, "Missing a value for %s\n", argument.c_str());
+				return false;
+			}
+
+			if (argument == "--frames") options.Frames = std::max(1, std::atoi(value));
+			else if (argument == "--warmup") options.WarmupFrames = std::max(0, std::atoi(value));
+			else if (argument == "--threads") options.Threads = std::atoi(value);
+			else if (argument == "--width") options.Width = std::max(1, std::atoi(value));
+			else if (argument == "--height") options.Height = std::max(1, std::atoi(value));
+			else if (argument == "--workload" && IsWorkload(value)) options.Workload = value;
+			else if (argument == "--workload")
+			{
+				std::fprintf(stderr, "Unknown workload %s\n", value);
+				PrintWorkloads();
+				return false;
+			}
+			else if (argument == "--mode" && std::strcmp(value, "automatic") == 0) options.Mode = ImGuiSDL::RenderMode::Automatic;
+			else if (argument == "--mode" && std::strcmp(value, "geometry") == 0) options.Mode = ImGuiSDL::RenderMode::Geometry;
+			else if (argument == "--mode" && std::strcmp(value, "rasterizer") == 0) options.Mode = ImGuiSDL::RenderMode::Rasterizer;
+			else if (argument == "--mode" && std::strcmp(value, "framebuffer") == 0) options.UseFramebuffer = true;
+			else
+			{
+				std::fprintf(stderr, "Unknown option %s %s\n", argument.c_str(), value);
+				return false;
+			}
+
+			i++;
+		}
+
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::fprintf(stderr, "Usage: imgui_sdl_bench [--frames N] [--warmup N] [--threads N] [--width N] [--height N] "
+			"[--mode automatic|geometry|rasterizer|framebuffer] [--workload NAME]\n");
+		return 1;
+	}
+
+	SDL_Init(0);
+
+	// The software renderer draws into a plain surface, so the benchmark needs neither a window nor a GPU.
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, options.Width, options.Height, 32, SDL_PIXELFORMAT_RGBA32);
+	SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : nullptr;
+	if (!renderer)
+	{
+		std::fprintf(stderr, "Couldn't create the software renderer: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	std::printf("{\"mode\": \"%s\", \"threads\": %d, \"width\": %d, \"height\": %d, \"warmup_frames\": %d, \"results\": [",
+		ModeName(options), options.Threads, options.Width, options.Height, options.WarmupFrames);
+
+	bool isFirst = true;
+	for (const Workload& workload : Workloads)
+	{
+		if (!options.Workload.empty() && options.Workload != workload.Name) continue;
+
+		RunWorkload(workload, renderer, surface, options, isFirst);
+		isFirst = false;
+	}
+
+	std::printf("\n]}\n");
+
+	SDL_DestroyRenderer(renderer);
+	SDL_FreeSurface(surface);
+	SDL_Quit();
+
+	return 0;
+}
@@ -4,518 +4,4588 @@
 
 #include "imgui.h"
 
-#include <map>
-#include <list>
 #include <cmath>
 #include <array>
 #include <vector>
-#include <memory>
 #include <iostream>
+#include <atomic>
+#include <thread>
 #include <algorithm>
 #include <functional>
+#include <unordered_set>
 #include <unordered_map>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <memory>
+#include <cassert>
+
+// The cache file is memory mapped, which takes the file APIs of the platform. SDL_RenderGeometryRaw is looked up from the SDL library that is
+// already loaded with the dynamic linker of the platform, see Device::LoadRenderGeometry.
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IMGUI_SDL_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define IMGUI_SDL_ARM64
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only let us use AVX2 intrinsics in functions that are explicitly compiled for it. MSVC allows them anywhere.
+// SSE2 is always there on x86-64, but 32 bit builds don't assume it, so the SSE2 kernels (picked with SDL_HasSSE2) need the same treatment.
+#if defined(IMGUI_SDL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define IMGUI_SDL_TARGET_SSE2 __attribute__((target("sse2")))
+#define IMGUI_SDL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define IMGUI_SDL_TARGET_SSE2
+#define IMGUI_SDL_TARGET_AVX2
+#endif
+
+// Define this to 1 to compile in the recording of timelines, see ImGuiSDL::StartTrace. Without it, none of the recording is compiled in.
+#ifndef IMGUI_SDL_TRACE
+#define IMGUI_SDL_TRACE 0
+#endif
 
 namespace
 {
-	struct Device* CurrentDevice = nullptr;
+	// The context the functions without a context parameter work on. See ImGuiSDL::Initialize.
+	ImGuiSDL::Context* DefaultContext = nullptr;
 
-	namespace TupleHash
+	double MillisecondsSince(Uint64 start)
 	{
-		template <typename T> struct Hash
-		{
-			std::size_t operator()(const T& value) const
-			{
-				return std::hash<T>()(value);
-			}
-		};
+		static const double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+		return static_cast<double>(SDL_GetPerformanceCounter() - start) * 1000.0 / frequency;
+	}
 
-		template <typename T> void CombineHash(std::size_t& seed, const T& value)
-		{
-			seed ^= TupleHash::Hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-		}
+	// Counts the textures we have made. A texture that gets made may land at the address of one that was destroyed, so whatever is remembered
+	// by the address of a texture only holds while the count stays the same. See RenderState.
+	std::atomic<unsigned int> TextureCreations(0);
 
-		template <typename Tuple, std::size_t Index = std::tuple_size<Tuple>::value - 1> struct Hasher
-		{
-			static void Hash(std::size_t& seed, const Tuple& tuple)
-			{
-				Hasher<Tuple, Index - 1>::Hash(seed, tuple);
-				CombineHash(seed, std::get<Index>(tuple));
-			}
-		};
+	SDL_Texture* CreateTexture(SDL_Renderer* renderer, Uint32 format, int access, int width, int height)
+	{
+		TextureCreations++;
+		return SDL_CreateTexture(renderer, format, access, width, height);
+	}
 
-		template <typename Tuple> struct Hasher<Tuple, 0>
-		{
-			static void Hash(std::size_t& seed, const Tuple& tuple)
-			{
-				CombineHash(seed, std::get<0>(tuple));
-			}
-		};
+	SDL_Texture* CreateTextureFromSurface(SDL_Renderer* renderer, SDL_Surface* surface)
+	{
+		TextureCreations++;
+		return SDL_CreateTextureFromSurface(renderer, surface);
+	}
+
+	// Adds the time between its construction and destruction to a counter of milliseconds.
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(double& milliseconds) : Milliseconds(milliseconds), Start(SDL_GetPerformanceCounter()) { }
+		~ScopedTimer() { Milliseconds += MillisecondsSince(Start); }
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	private:
+		double& Milliseconds;
+		Uint64 Start;
+	};
+
+	// Times the drawing of a whole draw list, which costs much less than timing every SDL call in it. Whatever of that time didn't go into
+	// classifying, rasterizing or uploading, which are timed on their own, counts as submission.
+	class SubmissionTimer
+	{
+	public:
+		explicit SubmissionTimer(ImGuiSDL::FrameStats& stats) : Stats(stats), Start(SDL_GetPerformanceCounter()), Measured(MeasuredTime()) { }
+		~SubmissionTimer() { Stats.SubmissionTime += std::max(0.0, MillisecondsSince(Start) - (MeasuredTime() - Measured)); }
+
+		SubmissionTimer(const SubmissionTimer&) = delete;
+		SubmissionTimer& operator=(const SubmissionTimer&) = delete;
+	private:
+		double MeasuredTime() const { return Stats.ClassificationTime + Stats.RasterizationTime + Stats.UploadTime; }
 
-		template <typename... T> struct Hash<std::tuple<T...>>
+		ImGuiSDL::FrameStats& Stats;
+		Uint64 Start;
+		double Measured;
+	};
+
+#if IMGUI_SDL_TRACE
+	// A zone of the timeline, which is recorded when it ends. The names are string literals, so the event only points at them.
+	struct TraceEvent
+	{
+		const char* Name;
+		const char* ArgumentName;
+		long long Argument;
+		Uint64 Start, End;
+	};
+
+	// The events of one thread. Only the thread itself writes into its buffer, so recording doesn't take a lock: the event is written
+	// first and the count is published after it. Once the buffer is full, the oldest events get overwritten. Starting a trace doesn't
+	// touch the buffers, it only moves on to a new epoch, and a thread that finds its buffer from an older epoch starts it over itself.
+	struct TraceBuffer
+	{
+		static constexpr std::size_t Capacity = 1 << 16;
+
+		std::unique_ptr<TraceEvent[]> Events{ new TraceEvent[Capacity] };
+		std::atomic<std::size_t> Count{ 0 };
+		std::atomic<unsigned int> Epoch{ 0 };
+
+		void Add(const TraceEvent& event, unsigned int epoch)
 		{
-			std::size_t operator()(const std::tuple<T...>& value) const
+			std::size_t count = Count.load(std::memory_order_relaxed);
+			if (Epoch.load(std::memory_order_relaxed) != epoch)
 			{
-				std::size_t seed = 0;
-				Hasher<std::tuple<T...>>::Hash(seed, value);
-				return seed;
+				count = 0;
+				Epoch.store(epoch, std::memory_order_relaxed);
 			}
-		};
-	}
 
-	template <typename Key, typename Value, std::size_t Size> class LRUCache
+			Events[count % Capacity] = event;
+			Count.store(count + 1, std::memory_order_release);
+		}
+	};
+
+	// Every thread that records anything gets a buffer of its own the first time it does, which is the only time a lock is taken. The
+	// buffers are kept until the program exits, so that the events of threads that are already gone can still be written out.
+	class Tracer
 	{
 	public:
-		bool Contains(const Key& key) const
+		static Tracer& Get()
 		{
-			return Container.find(key) != Container.end();
+			static Tracer tracer;
+			return tracer;
 		}
 
-		const Value& At(const Key& key)
+		bool IsRecording() const { return Recording.load(std::memory_order_relaxed); }
+		unsigned int GetEpoch() const { return Epoch.load(std::memory_order_relaxed); }
+
+		void Start()
 		{
-			assert(Contains(key));
+			std::lock_guard<std::mutex> lock(Mutex);
+			Epoch.fetch_add(1, std::memory_order_relaxed);
+			StartTime = SDL_GetPerformanceCounter();
+			Recording.store(true, std::memory_order_release);
+		}
+
+		void Stop() { Recording.store(false, std::memory_order_release); }
 
-			const auto location = Container.find(key);
-			Order.splice(Order.begin(), Order, location->second);
-			return location->second->second;
+		// Render and Prepare count themselves as busy for as long as they run, since their worker threads only record while they do.
+		void EnterFrame() { BusyFrames.fetch_add(1, std::memory_order_acquire); }
+		void LeaveFrame() { BusyFrames.fetch_sub(1, std::memory_order_release); }
+
+		TraceBuffer& GetThreadBuffer()
+		{
+			thread_local TraceBuffer* buffer = nullptr;
+			if (!buffer)
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Buffers.emplace_back(new TraceBuffer());
+				buffer = Buffers.back().get();
+			}
+			return *buffer;
 		}
 
-		void Insert(const Key& key, Value value)
+		// Writes the events as complete events of the Chrome trace event format, with times in microseconds since the start of the trace.
+		// Every buffer becomes a thread of its own in the timeline. The events are read without the threads that record them knowing, so
+		// this may only be called while no frame is being rendered or prepared, and fails while a trace is being recorded.
+		bool Write(const char* path)
 		{
-			const auto existingLocation = Container.find(key);
-			if (existingLocation != Container.end())
+			assert(BusyFrames.load(std::memory_order_acquire) == 0);
+			if (IsRecording()) return false;
+			std::lock_guard<std::mutex> lock(Mutex);
+
+			static const double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+			const auto microseconds = [this](Uint64 time) { return static_cast<double>(static_cast<long long>(time - StartTime)) * 1000000.0 / frequency; };
+
+			std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+			char line[256];
+			bool isFirst = true;
+			const auto append = [&json, &isFirst](const char* text) {
+				if (!isFirst) json += ",\n";
+				json += text;
+				isFirst = false;
+			};
+
+			for (std::size_t thread = 0; thread < Buffers.size(); thread++)
 			{
-				Order.erase(existingLocation->second);
-				Container.erase(existingLocation);
+				const TraceBuffer& buffer = *Buffers[thread];
+				const bool isRecent = buffer.Epoch.load(std::memory_order_relaxed) == GetEpoch();
+
+				std::snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+					static_cast<int>(thread), static_cast<int>(thread));
+				append(line);
+
+				// Threads that didn't record anything since the trace was started still have the events of an older one.
+				const std::size_t count = isRecent ? buffer.Count.load(std::memory_order_acquire) : 0;
+				for (std::size_t i = count > TraceBuffer::Capacity ? count - TraceBuffer::Capacity : 0; i < count; i++)
+				{
+					const TraceEvent& event = buffer.Events[i % TraceBuffer::Capacity];
+					const double start = microseconds(event.Start);
+					const double duration = microseconds(event.End) - start;
+
+					const int length = std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+						event.Name, static_cast<int>(thread), start, duration);
+					if (length < 0 || static_cast<std::size_t>(length) >= sizeof(line)) continue;
+					if (event.ArgumentName) std::snprintf(line + length, sizeof(line) - length, ",\"args\":{\"%s\":%lld}}", event.ArgumentName, event.Argument);
+					else std::snprintf(line + length, sizeof(line) - length, "}");
+					append(line);
+				}
 			}
+			json += "]}\n";
 
-			Order.push_front(std::make_pair(key, std::move(value)));
-			Container.insert(std::make_pair(key, Order.begin()));
+			SDL_RWops* file = SDL_RWFromFile(path, "wb");
+			if (!file) return false;
 
-			Clean();
+			const bool isWritten = SDL_RWwrite(file, json.data(), json.size(), 1) == 1;
+			return SDL_RWclose(file) == 0 && isWritten;
 		}
 	private:
-		void Clean()
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<TraceBuffer>> Buffers;
+		std::atomic<bool> Recording{ false };
+		std::atomic<unsigned int> Epoch{ 0 };
+		std::atomic<int> BusyFrames{ 0 };
+		Uint64 StartTime = 0;
+	};
+
+	// Records the time between its construction and destruction as a zone of the timeline, along with a number that says something about
+	// the zone, like the pixels of a triangle. Does next to nothing while no trace is being recorded.
+	class TraceZone
+	{
+	public:
+		explicit TraceZone(const char* name, const char* argumentName = nullptr, long long argument = 0)
+			: Name(name), ArgumentName(argumentName), Argument(argument), Start(Tracer::Get().IsRecording() ? SDL_GetPerformanceCounter() : 0) { }
+
+		~TraceZone()
 		{
-			while (Container.size() > Size)
-			{
-				auto last = Order.end();
-				last--;
-				Container.erase(last->first);
-				Order.pop_back();
-			}
+			Tracer& tracer = Tracer::Get();
+			if (Start == 0 || !tracer.IsRecording()) return;
+			tracer.GetThreadBuffer().Add({ Name, ArgumentName, Argument, Start, SDL_GetPerformanceCounter() }, tracer.GetEpoch());
 		}
 
-		std::list<std::pair<Key, Value>> Order;
-		std::unordered_map<Key, decltype(Order.begin()), TupleHash::Hash<Key>> Container;
+		TraceZone(const TraceZone&) = delete;
+		TraceZone& operator=(const TraceZone&) = delete;
+	private:
+		const char* Name;
+		const char* ArgumentName;
+		long long Argument;
+		Uint64 Start;
 	};
 
-	struct Color
+#define IMGUI_SDL_TRACE_JOIN(a, b) a##b
+#define IMGUI_SDL_TRACE_NAME(line) IMGUI_SDL_TRACE_JOIN(traceZone, line)
+	// Marks Render and Prepare as busy while they run. See Tracer::Write.
+	class TraceFrame
 	{
-		const float R, G, B, A;
+	public:
+		TraceFrame() { Tracer::Get().EnterFrame(); }
+		~TraceFrame() { Tracer::Get().LeaveFrame(); }
 
-		explicit Color(uint32_t color)
-			: R(((color >> 0) & 0xff) / 255.0f), G(((color >> 8) & 0xff) / 255.0f), B(((color >> 16) & 0xff) / 255.0f), A(((color >> 24) & 0xff) / 255.0f) { }
-		Color(float r, float g, float b, float a) : R(r), G(g), B(b), A(a) { }
+		TraceFrame(const TraceFrame&) = delete;
+		TraceFrame& operator=(const TraceFrame&) = delete;
+	};
+
+#define IMGUI_SDL_TRACE_ZONE(...) TraceZone IMGUI_SDL_TRACE_NAME(__LINE__)(__VA_ARGS__)
+#define IMGUI_SDL_TRACE_FRAME() TraceFrame IMGUI_SDL_TRACE_NAME(__LINE__)
+#else
+#define IMGUI_SDL_TRACE_ZONE(...)
+#define IMGUI_SDL_TRACE_FRAME()
+#endif
+
+	// Cache keys are packed into a few 64 bit integers, so comparing and hashing them is just a handful of integer operations.
+	template <std::size_t WordCount> struct PackedKey
+	{
+		std::array<uint64_t, WordCount> Words{};
 
-		Color operator*(const Color& c) const { return Color(R * c.R, G * c.G, B * c.B, A * c.A); }
-		Color operator*(float v) const { return Color(R * v, G * v, B * v, A * v); }
-		Color operator+(const Color& c) const { return Color(R + c.R, G + c.G, B + c.B, A + c.A); }
+		bool operator==(const PackedKey& other) const { return Words == other.Words; }
+		bool operator!=(const PackedKey& other) const { return Words != other.Words; }
 
-		uint32_t ToInt() const
+		std::size_t Hash() const
 		{
-			return	((static_cast<int>(R * 255) & 0xff) << 0)
-				  | ((static_cast<int>(G * 255) & 0xff) << 8)
-				  | ((static_cast<int>(B * 255) & 0xff) << 16)
-				  | ((static_cast<int>(A * 255) & 0xff) << 24);
+			uint64_t hash = 0x9e3779b97f4a7c15ull;
+			for (const uint64_t word : Words)
+			{
+				hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+				hash ^= hash >> 32;
+			}
+			return static_cast<std::size_t>(hash);
 		}
 
-		void UseAsDrawColor(SDL_Renderer* renderer) const
+		struct Hasher
+		{
+			std::size_t operator()(const PackedKey& key) const { return key.Hash(); }
+		};
+	};
+
+	// Appends fields of a given bit width into the words of a PackedKey, starting from the lowest bits of the first word.
+	template <std::size_t WordCount> class KeyPacker
+	{
+	public:
+		explicit KeyPacker(PackedKey<WordCount>& key) : Key(key) { }
+
+		// Running out of words would make keys that differ only in the last values collide, so the keys are sized to always fit.
+		void Push(uint64_t value, int bits)
 		{
-			SDL_SetRenderDrawColor(renderer,
-				static_cast<uint8_t>(R * 255),
-				static_cast<uint8_t>(G * 255),
-				static_cast<uint8_t>(B * 255),
-				static_cast<uint8_t>(A * 255));
+			assert(Word < WordCount && (Bit + bits <= 64 || Word + 1 < WordCount));
+			value &= bits == 64 ? ~0ull : (1ull << bits) - 1;
+
+			Key.Words[Word] |= value << Bit;
+			if (Bit + bits > 64) Key.Words[Word + 1] |= value >> (64 - Bit);
+
+			Bit += bits;
+			if (Bit >= 64)
+			{
+				Word++;
+				Bit -= 64;
+			}
 		}
+	private:
+		PackedKey<WordCount>& Key;
+		std::size_t Word = 0;
+		int Bit = 0;
 	};
 
-	struct Device
+	// A least recently used cache with a budget in bytes. Every entry is inserted along with its size, and the least recently used entries
+	// are evicted until the new one fits. The entries live in a flat array and are chained into a doubly linked recency list by index, and
+	// they are found through an open addressing hash table with linear probing. Slots of removed entries are reused, so once the cache has
+	// grown to its working size, lookups and inserts don't allocate. Key needs a Hash method.
+	template <typename Key, typename Value> class LRUCache
 	{
-		SDL_Renderer* Renderer;
+	public:
+		explicit LRUCache(std::size_t budget) : Budget(budget), Table(16, Empty) { }
 
-		struct ClipRect
+		// Returns the cached value and marks it as the most recently used one, or null if the key isn't cached.
+		Value* Find(const Key& key)
 		{
-			int X, Y, Width, Height;
-		} Clip;
+			const uint32_t index = Table[Locate(key, key.Hash())];
+			if (index == Empty) return nullptr;
 
-		struct TriangleCacheItem
+			MoveToFront(index);
+			return &Entries[index].CachedValue;
+		}
+
+		// Entries bigger than the whole budget aren't cached at all.
+		void Insert(const Key& key, Value value, std::size_t bytes)
 		{
-			SDL_Texture* Texture = nullptr;
-			int Width = 0, Height = 0;
+			const std::size_t hash = key.Hash();
+			Remove(key);
 
-			~TriangleCacheItem() { if (Texture) SDL_DestroyTexture(Texture); }
-		};
+			if (bytes > Budget) return;
+			EvictToFit(bytes);
 
-		// You can tweak these to values that you find that work the best.
-		static constexpr std::size_t UniformColorTriangleCacheSize = 512;
-		static constexpr std::size_t GenericTriangleCacheSize = 64;
+			uint32_t index;
+			if (!FreeEntries.empty())
+			{
+				index = FreeEntries.back();
+				FreeEntries.pop_back();
+			}
+			else
+			{
+				index = static_cast<uint32_t>(Entries.size());
+				Entries.emplace_back();
+			}
 
-		// Uniform color is identified by its color and the coordinates of the edges.
-		using UniformColorTriangleKey = std::tuple<uint32_t, int, int, int, int, int, int>;
-		// The generic triangle cache unfortunately has to be basically a full representation of the triangle.
-		// This includes the (offset) vertex positions, texture coordinates and vertex colors.
-		using GenericTriangleVertexKey = std::tuple<int, int, double, double, uint32_t>;
-		using GenericTriangleKey = std::tuple<GenericTriangleVertexKey, GenericTriangleVertexKey, GenericTriangleVertexKey>;
+			// The table is kept at most half full so that the probe sequences stay short.
+			if ((Count + 1) * 2 > Table.size()) Rehash(Table.size() * 2);
 
-		LRUCache<UniformColorTriangleKey, std::unique_ptr<TriangleCacheItem>, UniformColorTriangleCacheSize> UniformColorTriangleCache;
-		LRUCache<GenericTriangleKey, std::unique_ptr<TriangleCacheItem>, GenericTriangleCacheSize> GenericTriangleCache;
+			Table[Locate(key, hash)] = index;
+			Count++;
+			UsedBytes += bytes;
 
-		Device(SDL_Renderer* renderer) : Renderer(renderer) { }
+			Entry& entry = Entries[index];
+			entry.CachedKey = key;
+			entry.Hash = hash;
+			entry.CachedValue = std::move(value);
+			entry.Bytes = bytes;
+			LinkToFront(index);
+		}
 
-		void SetClipRect(const ClipRect& rect)
+		void Remove(const Key& key)
 		{
-			Clip = rect;
-			const SDL_Rect clip = { rect.X, rect.Y, rect.Width, rect.Height };
-			SDL_RenderSetClipRect(Renderer, &clip);
+			const std::size_t bucket = Locate(key, key.Hash());
+			if (Table[bucket] != Empty) RemoveAt(bucket);
 		}
 
-		void EnableClip() { SetClipRect(Clip); }
-		void DisableClip() { SDL_RenderSetClipRect(Renderer, nullptr); }
+		// Removes every entry. These don't count as evictions, as it wasn't the budget that made them go.
+		void Clear()
+		{
+			while (Head != Empty) RemoveAt(Locate(Entries[Head].CachedKey, Entries[Head].Hash));
+		}
 
-		void SetAt(int x, int y, const Color& color)
+		// Evicts right away if the cache is now over the budget.
+		void SetBudget(std::size_t budget)
 		{
-			color.UseAsDrawColor(Renderer);
-			SDL_RenderDrawPoint(Renderer, x, y);
+			Budget = budget;
+			EvictToFit(0);
 		}
 
-		SDL_Texture* MakeTexture(int width, int height)
+		// Calls the function with the key and the value of every entry, from the most recently used to the least recently used.
+		template <typename Function> void ForEach(const Function& function) const
 		{
-			SDL_Texture* texture = SDL_CreateTexture(Renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, width, height);
-			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-			return texture;
+			for (uint32_t index = Head; index != Empty; index = Entries[index].Next) function(Entries[index].CachedKey, Entries[index].CachedValue);
 		}
 
-		void UseAsRenderTarget(SDL_Texture* texture)
+		std::size_t GetCount() const { return Count; }
+		std::size_t GetUsedBytes() const { return UsedBytes; }
+		std::size_t GetBudget() const { return Budget; }
+		std::size_t GetEvictionCount() const { return Evictions; }
+	private:
+		enum : uint32_t { Empty = 0xffffffff };
+
+		struct Entry
+		{
+			Key CachedKey;
+			std::size_t Hash = 0;
+			Value CachedValue;
+			std::size_t Bytes = 0;
+			uint32_t Previous = Empty, Next = Empty;
+		};
+
+		void EvictToFit(std::size_t bytes)
 		{
-			SDL_SetRenderTarget(Renderer, texture);
-			if (texture)
+			while (Tail != Empty && UsedBytes + bytes > Budget)
 			{
-				SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 0);
-				SDL_RenderClear(Renderer);
+				RemoveAt(Locate(Entries[Tail].CachedKey, Entries[Tail].Hash));
+				Evictions++;
 			}
 		}
-	};
 
-	struct Texture
-	{
-		SDL_Surface* Surface;
-		SDL_Texture* Source;
+		void RemoveAt(std::size_t bucket)
+		{
+			const uint32_t index = Table[bucket];
+			Unlink(index);
+			Erase(bucket);
+
+			Entry& entry = Entries[index];
+			entry.CachedValue = Value();
+			UsedBytes -= entry.Bytes;
+			Count--;
+			FreeEntries.push_back(index);
+		}
 
-		~Texture()
+		void Rehash(std::size_t size)
 		{
-			SDL_FreeSurface(Surface);
-			SDL_DestroyTexture(Source);
+			Table.assign(size, Empty);
+			for (uint32_t index = Head; index != Empty; index = Entries[index].Next)
+			{
+				Table[Locate(Entries[index].CachedKey, Entries[index].Hash)] = index;
+			}
 		}
 
-		Color Sample(float u, float v) const
+		// Returns the bucket holding the key, or the empty bucket where it would be inserted.
+		std::size_t Locate(const Key& key, std::size_t hash) const
 		{
-			const int x = static_cast<int>(std::round(u * (Surface->w - 1) + 0.5f));
-			const int y = static_cast<int>(std::round(v * (Surface->h - 1) + 0.5f));
+			const std::size_t mask = Table.size() - 1;
+			for (std::size_t bucket = hash & mask;; bucket = (bucket + 1) & mask)
+			{
+				const uint32_t index = Table[bucket];
+				if (index == Empty || (Entries[index].Hash == hash && Entries[index].CachedKey == key)) return bucket;
+			}
+		}
 
-			const int location = y * Surface->w + x;
-			assert(location < Surface->w * Surface->h);
+		// Removes a bucket with backward shift deletion, which keeps every remaining key reachable from its home bucket without tombstones.
+		void Erase(std::size_t bucket)
+		{
+			const std::size_t mask = Table.size() - 1;
+			for (std::size_t next = (bucket + 1) & mask; Table[next] != Empty; next = (next + 1) & mask)
+			{
+				const std::size_t home = Entries[Table[next]].Hash & mask;
+				if (((next - home) & mask) >= ((next - bucket) & mask))
+				{
+					Table[bucket] = Table[next];
+					bucket = next;
+				}
+			}
+			Table[bucket] = Empty;
+		}
 
-			return Color(static_cast<uint32_t*>(Surface->pixels)[location]);
+		void Unlink(uint32_t index)
+		{
+			Entry& entry = Entries[index];
+			if (entry.Previous != Empty) Entries[entry.Previous].Next = entry.Next; else Head = entry.Next;
+			if (entry.Next != Empty) Entries[entry.Next].Previous = entry.Previous; else Tail = entry.Previous;
+			entry.Previous = entry.Next = Empty;
 		}
-	};
 
-	template <typename T> class InterpolatedFactorEquation
-	{
-	public:
-		InterpolatedFactorEquation(const T& value0, const T& value1, const T& value2, const ImVec2& v0, const ImVec2& v1, const ImVec2& v2)
-			: Value0(value0), Value1(value1), Value2(value2), V0(v0), V1(v1), V2(v2),
-			Divisor((V1.y - V2.y) * (V0.x - V2.x) + (V2.x - V1.x) * (V0.y - V2.y)) { }
+		void LinkToFront(uint32_t index)
+		{
+			Entry& entry = Entries[index];
+			entry.Previous = Empty;
+			entry.Next = Head;
+			if (Head != Empty) Entries[Head].Previous = index; else Tail = index;
+			Head = index;
+		}
 
-		T Evaluate(float x, float y) const
+		void MoveToFront(uint32_t index)
 		{
-			const float w1 = ((V1.y - V2.y) * (x - V2.x) + (V2.x - V1.x) * (y - V2.y)) / Divisor;
-			const float w2 = ((V2.y - V0.y) * (x - V2.x) + (V0.x - V2.x) * (y - V2.y)) / Divisor;
-			const float w3 = 1.0f - w1 - w2;
+			if (Head == index) return;
 
-			return static_cast<T>((Value0 * w1) + (Value1 * w2) + (Value2 * w3));
+			Unlink(index);
+			LinkToFront(index);
 		}
-	private:
-		const T Value0;
-		const T Value1;
-		const T Value2;
 
-		const ImVec2& V0;
-		const ImVec2& V1;
-		const ImVec2& V2;
-
-		const float Divisor;
+		std::size_t Budget;
+		std::vector<Entry> Entries;
+		std::vector<uint32_t> FreeEntries;
+		std::vector<uint32_t> Table;
+		std::size_t Count = 0, UsedBytes = 0;
+		uint32_t Head = Empty, Tail = Empty;
+		std::size_t Evictions = 0;
 	};
 
-	struct Rect
+	struct Color
 	{
-		float MinX, MinY, MaxX, MaxY;
-		float MinU, MinV, MaxU, MaxV;
+		const float R, G, B, A;
 
-		bool IsOnExtreme(const ImVec2& point) const
+		explicit Color(uint32_t color)
+			: R(((color >> 0) & 0xff) / 255.0f), G(((color >> 8) & 0xff) / 255.0f), B(((color >> 16) & 0xff) / 255.0f), A(((color >> 24) & 0xff) / 255.0f) { }
+		Color(float r, float g, float b, float a) : R(r), G(g), B(b), A(a) { }
+
+		// The color as the four 8 bit channels SDL takes, packed like ImGui packs them.
+		uint32_t ToBytes() const
 		{
-			return (point.x == MinX || point.x == MaxX) && (point.y == MinY || point.y == MaxY);
+			return static_cast<uint32_t>(static_cast<uint8_t>(R * 255))
+				| static_cast<uint32_t>(static_cast<uint8_t>(G * 255)) << 8
+				| static_cast<uint32_t>(static_cast<uint8_t>(B * 255)) << 16
+				| static_cast<uint32_t>(static_cast<uint8_t>(A * 255)) << 24;
 		}
+	};
 
-		bool UsesOnlyColor() const
+	// Packs the rasterized triangles into a handful of large textures instead of giving every cached triangle a texture of its own. That way
+	// drawing the cached triangles keeps binding the same few textures, which lets SDL batch the copies, and the cache doesn't keep creating
+	// and destroying tiny textures as entries come and go.
+	class TriangleAtlas
+	{
+	public:
+		// Where a triangle ended up. Page is -1 if the triangle didn't fit into a page and got a texture of its own, which the item then owns.
+		struct Location
 		{
-			const ImVec2& whitePixel = ImGui::GetIO().Fonts->TexUvWhitePixel;
+			SDL_Texture* Texture = nullptr;
+			SDL_Rect Source = { 0, 0, 0, 0 };
+			int Page = -1;
+			unsigned int Generation = 0;
+			// Which stretch of keeping pixels the triangle was stored in, or 0 if its pixels weren't kept. See SetKeepsPixels.
+			unsigned int KeptEpoch = 0;
+		};
 
-			return MinU == MaxU && MinU == whitePixel.x && MinV == MaxV && MaxV == whitePixel.y;
+		// You can tweak this to a value that you find that works the best.
+		static constexpr int PageSize = 1024;
+
+		TriangleAtlas(SDL_Renderer* renderer, ImGuiSDL::FrameStats& stats) : Renderer(renderer), Stats(stats)
+		{
+			SDL_RendererInfo info;
+			if (renderer && SDL_GetRendererInfo(renderer, &info) == 0)
+			{
+				if (info.max_texture_width > 0) PageWidth = std::min(PageWidth, info.max_texture_width);
+				if (info.max_texture_height > 0) PageHeight = std::min(PageHeight, info.max_texture_height);
+			}
 		}
 
-		static Rect CalculateBoundingBox(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2)
+		~TriangleAtlas()
 		{
-			return Rect{
-				std::min({ v0.pos.x, v1.pos.x, v2.pos.x }),
-				std::min({ v0.pos.y, v1.pos.y, v2.pos.y }),
-				std::max({ v0.pos.x, v1.pos.x, v2.pos.x }),
-				std::max({ v0.pos.y, v1.pos.y, v2.pos.y }),
-				std::min({ v0.uv.x, v1.uv.x, v2.uv.x }),
-				std::min({ v0.uv.y, v1.uv.y, v2.uv.y }),
-				std::max({ v0.uv.x, v1.uv.x, v2.uv.x }),
-				std::max({ v0.uv.y, v1.uv.y, v2.uv.y })
-			};
+			for (const auto& page : Pages) SDL_DestroyTexture(page.Texture);
 		}
-	};
 
-	struct FixedPointTriangleRenderInfo
-	{
-		int X1, X2, X3, Y1, Y2, Y3;
-		int MinX, MaxX, MinY, MaxY;
+		TriangleAtlas(const TriangleAtlas&) = delete;
+		TriangleAtlas& operator=(const TriangleAtlas&) = delete;
 
-		static FixedPointTriangleRenderInfo CalculateFixedPointTriangleInfo(const ImVec2& v1, const ImVec2& v2, const ImVec2& v3)
+		// Finds room for a width x height image and uploads the pixels there.
+		Location Store(int width, int height, const uint32_t* pixels, unsigned int frame)
 		{
-			static constexpr float scale = 16.0f;
+			ScopedTimer timer(Stats.UploadTime);
+			IMGUI_SDL_TRACE_ZONE("Upload triangle", "pixels", static_cast<long long>(width) * height);
 
-			const int x1 = static_cast<int>(std::round(v1.x * scale));
-			const int x2 = static_cast<int>(std::round(v2.x * scale));
-			const int x3 = static_cast<int>(std::round(v3.x * scale));
+			Location location;
+			location.Source = { 0, 0, width, height };
 
-			const int y1 = static_cast<int>(std::round(v1.y * scale));
-			const int y2 = static_cast<int>(std::round(v2.y * scale));
-			const int y3 = static_cast<int>(std::round(v3.y * scale));
+			if (width > PageWidth || height > PageHeight)
+			{
+				// Doesn't fit into any page, so it gets a texture of its own.
+				location.Texture = MakeTexture(width, height);
+			}
+			else
+			{
+				const int pageIndex = Allocate(width, height, location.Source);
+				Page& page = Pages[pageIndex];
+				page.LastUse = frame;
 
-			int minX = (std::min({ x1, x2, x3 }) + 0xF) >> 4;
-			int maxX = (std::max({ x1, x2, x3 }) + 0xF) >> 4;
-			int minY = (std::min({ y1, y2, y3 }) + 0xF) >> 4;
-			int maxY = (std::max({ y1, y2, y3 }) + 0xF) >> 4;
+				location.Texture = page.Texture;
+				location.Page = pageIndex;
+				location.Generation = page.Generation;
+			}
 
-			return FixedPointTriangleRenderInfo{ x1, x2, x3, y1, y2, y3, minX, maxX, minY, maxY };
+			SDL_UpdateTexture(location.Texture, &location.Source, pixels, width * static_cast<int>(sizeof(uint32_t)));
+			Stats.SDLCalls++;
+
+			if (KeepsPixels && location.Page >= 0)
+			{
+				location.KeptEpoch = KeptEpoch;
+				std::vector<uint32_t>& copy = Pages[location.Page].Pixels;
+				copy.resize(static_cast<std::size_t>(PageWidth) * PageHeight);
+				for (int y = 0; y < height; y++)
+				{
+					std::copy_n(pixels + static_cast<std::size_t>(y) * width, width, copy.begin() + static_cast<std::size_t>(location.Source.y + y) * PageWidth + location.Source.x);
+				}
+			}
+			return location;
 		}
-	};
 
-	void DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const std::function<Color(float x, float y)>& colorFunction, Device::TriangleCacheItem* cacheItem)
-	{
-		// Implementation source: https://web.archive.org/web/20171128164608/http://forum.devmaster.net/t/advanced-rasterization/6145.
-		// This is a fixed point implementation that rounds to top-left.
+		// Textures can't be read back, so the pages keep a copy of everything that was uploaded into them while this is set. Triangles with a
+		// texture of their own are never kept. Triangles that were already in the atlas when keeping was turned on have nothing in the copy,
+		// so every time it's turned on starts a new epoch, and only the locations stored during the current one have their pixels kept.
+		void SetKeepsPixels(bool keepsPixels)
+		{
+			if (keepsPixels && !KeepsPixels) KeptEpoch++;
+			KeepsPixels = keepsPixels;
+			if (!keepsPixels) for (auto& page : Pages) std::vector<uint32_t>().swap(page.Pixels);
+		}
 
-		const int deltaX12 = renderInfo.X1 - renderInfo.X2;
-		const int deltaX23 = renderInfo.X2 - renderInfo.X3;
-		const int deltaX31 = renderInfo.X3 - renderInfo.X1;
+		// The kept pixels of a location, with rows that are pitch pixels apart, or null if they weren't kept.
+		const uint32_t* PixelsAt(const Location& location, int& pitch) const
+		{
+			if (location.Page < 0 || !IsValid(location) || !KeepsPixels || location.KeptEpoch != KeptEpoch) return nullptr;
 
-		const int deltaY12 = renderInfo.Y1 - renderInfo.Y2;
-		const int deltaY23 = renderInfo.Y2 - renderInfo.Y3;
-		const int deltaY31 = renderInfo.Y3 - renderInfo.Y1;
+			pitch = PageWidth;
+			return Pages[location.Page].Pixels.data() + static_cast<std::size_t>(location.Source.y) * PageWidth + location.Source.x;
+		}
 
-		const int fixedDeltaX12 = deltaX12 << 4;
-		const int fixedDeltaX23 = deltaX23 << 4;
-		const int fixedDeltaX31 = deltaX31 << 4;
+		// A location becomes invalid when the page it lives in gets evicted and reused for other triangles, or gets dropped altogether.
+		bool IsValid(const Location& location) const
+		{
+			return location.Page < 0 || (static_cast<std::size_t>(location.Page) < Pages.size() && Pages[location.Page].Generation == location.Generation);
+		}
 
-		const int fixedDeltaY12 = deltaY12 << 4;
-		const int fixedDeltaY23 = deltaY23 << 4;
-		const int fixedDeltaY31 = deltaY31 << 4;
+		void Touch(const Location& location, unsigned int frame)
+		{
+			if (IsValid(location) && location.Page >= 0) Pages[location.Page].LastUse = frame;
+		}
 
-		const int width = renderInfo.MaxX - renderInfo.MinX;
-		const int height = renderInfo.MaxY - renderInfo.MinY;
-		if (width == 0 || height == 0) return;
+		// Limits the pages to as many as it takes to hold the given number of bytes, but always allows at least one. The budget may change in
+		// the middle of a frame that still draws out of the pages over the limit, so those are only destroyed by Trim.
+		void SetBudget(std::size_t bytes)
+		{
+			const std::size_t pageBytes = static_cast<std::size_t>(PageWidth) * PageHeight * sizeof(uint32_t);
+			MaxPages = std::max<std::size_t>(1, (bytes + pageBytes - 1) / pageBytes);
+		}
 
-		int c1 = deltaY12 * renderInfo.X1 - deltaX12 * renderInfo.Y1;
-		int c2 = deltaY23 * renderInfo.X2 - deltaX23 * renderInfo.Y2;
-		int c3 = deltaY31 * renderInfo.X3 - deltaX31 * renderInfo.Y3;
+		// Destroys the pages over the limit. Called at the end of a frame, once nothing of it is waiting to be drawn anymore.
+		void Trim()
+		{
+			while (Pages.size() > MaxPages)
+			{
+				SDL_DestroyTexture(Pages.back().Texture);
+				Pages.pop_back();
+			}
+		}
 
-		if (deltaY12 < 0 || (deltaY12 == 0 && deltaX12 > 0)) c1++;
-		if (deltaY23 < 0 || (deltaY23 == 0 && deltaX23 > 0)) c2++;
-		if (deltaY31 < 0 || (deltaY31 == 0 && deltaX31 > 0)) c3++;
+		std::size_t GetPageCount() const { return Pages.size(); }
 
-		int edgeStart1 = c1 + deltaX12 * (renderInfo.MinY << 4) - deltaY12 * (renderInfo.MinX << 4);
-		int edgeStart2 = c2 + deltaX23 * (renderInfo.MinY << 4) - deltaY23 * (renderInfo.MinX << 4);
-		int edgeStart3 = c3 + deltaX31 * (renderInfo.MinY << 4) - deltaY31 * (renderInfo.MinX << 4);
+		SDL_Texture* MakeTexture(int width, int height)
+		{
+			IMGUI_SDL_TRACE_ZONE("Create texture", "pixels", static_cast<long long>(width) * height);
 
-		SDL_Texture* cache = CurrentDevice->MakeTexture(width, height);
-		CurrentDevice->DisableClip();
-		CurrentDevice->UseAsRenderTarget(cache);
+			// The pixels are packed like ImGui packs its colors, with red in the lowest byte. ABGR8888 describes exactly that layout regardless of the
+			// endianness of the platform (it's the same format that RGBA32 maps to on little endian machines).
+			SDL_Texture* texture = CreateTexture(Renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, width, height);
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+			Stats.SDLCalls += 2;
+			return texture;
+		}
+	private:
+		// The pages are filled with a simple shelf packer: each shelf is a horizontal strip as tall as the first triangle placed on it, and
+		// triangles are appended to the shelf left to right.
+		struct Shelf
+		{
+			int Y, Height, X;
+		};
 
-		for (int y = renderInfo.MinY; y < renderInfo.MaxY; y++)
+		struct Page
 		{
-			int edge1 = edgeStart1;
-			int edge2 = edgeStart2;
-			int edge3 = edgeStart3;
+			SDL_Texture* Texture;
+			std::vector<Shelf> Shelves;
+			int UsedHeight;
+			unsigned int Generation;
+			unsigned int LastUse;
+
+			// A copy of what was uploaded into the texture, while KeepsPixels is set.
+			std::vector<uint32_t> Pixels;
+		};
 
-			for (int x = renderInfo.MinX; x < renderInfo.MaxX; x++)
+		int Allocate(int width, int height, SDL_Rect& rect)
+		{
+			for (std::size_t i = 0; i < Pages.size(); i++)
 			{
-				if (edge1 > 0 && edge2 > 0 && edge3 > 0)
-				{
-					CurrentDevice->SetAt(x - renderInfo.MinX, y - renderInfo.MinY, colorFunction(x + 0.5f, y + 0.5f));
-				}
+				if (AllocateInPage(Pages[i], width, height, rect)) return static_cast<int>(i);
+			}
 
-				edge1 -= fixedDeltaY12;
-				edge2 -= fixedDeltaY23;
-				edge3 -= fixedDeltaY31;
+			if (Pages.size() < MaxPages)
+			{
+				Pages.push_back(Page{ MakeTexture(PageWidth, PageHeight), {}, 0, NextGeneration++, 0, {} });
+				AllocateInPage(Pages.back(), width, height, rect);
+				return static_cast<int>(Pages.size()) - 1;
 			}
 
-			edgeStart1 += fixedDeltaX12;
-			edgeStart2 += fixedDeltaX23;
-			edgeStart3 += fixedDeltaX31;
+			// Everything is full, so we throw away the page that was used the longest time ago. The shelf packer can't free individual
+			// triangles, so eviction happens a whole page at a time. A new generation invalidates every cache item pointing into it. Generations
+			// are never reused, so that items can't come back to life when a dropped page is created again.
+			const auto leastRecentlyUsed = std::min_element(Pages.begin(), Pages.end(),
+				[](const Page& a, const Page& b) { return a.LastUse < b.LastUse; });
+			leastRecentlyUsed->Shelves.clear();
+			leastRecentlyUsed->UsedHeight = 0;
+			leastRecentlyUsed->Generation = NextGeneration++;
+			Stats.AtlasEvictions++;
+
+			AllocateInPage(*leastRecentlyUsed, width, height, rect);
+			return static_cast<int>(leastRecentlyUsed - Pages.begin());
 		}
 
-		CurrentDevice->UseAsRenderTarget(nullptr);
-		CurrentDevice->EnableClip();
+		bool AllocateInPage(Page& page, int width, int height, SDL_Rect& rect) const
+		{
+			// Prefer the shortest shelf that fits, so that small triangles don't waste the space of tall shelves.
+			Shelf* best = nullptr;
+			for (auto& shelf : page.Shelves)
+			{
+				if (shelf.Height >= height && shelf.X + width <= PageWidth && (!best || shelf.Height < best->Height))
+				{
+					best = &shelf;
+				}
+			}
 
-		cacheItem->Texture = cache;
-		cacheItem->Width = width;
-		cacheItem->Height = height;
-	}
+			if (!best || best->Height > height * 2)
+			{
+				if (page.UsedHeight + height <= PageHeight)
+				{
+					page.Shelves.push_back(Shelf{ page.UsedHeight, height, 0 });
+					page.UsedHeight += height;
+					best = &page.Shelves.back();
+				}
+				else if (!best)
+				{
+					return false;
+				}
+			}
 
-	void DrawCachedTriangle(const Device::TriangleCacheItem& triangle, const FixedPointTriangleRenderInfo& renderInfo)
-	{
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, triangle.Width, triangle.Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, triangle.Texture, nullptr, &destination);
-	}
+			rect = { best->X, best->Y, width, height };
+			best->X += width;
+			return true;
+		}
 
-	void DrawTriangle(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture)
-	{
-		// The naming inconsistency in the parameters is intentional. The fixed point algorithm wants the vertices in a counter clockwise order.
-		const auto& renderInfo = FixedPointTriangleRenderInfo::CalculateFixedPointTriangleInfo(v3.pos, v2.pos, v1.pos);
+		SDL_Renderer* Renderer;
+		ImGuiSDL::FrameStats& Stats;
+		int PageWidth = PageSize, PageHeight = PageSize;
+		std::size_t MaxPages = 1;
+		unsigned int NextGeneration = 0;
+		std::vector<Page> Pages;
+		bool KeepsPixels = false;
+		unsigned int KeptEpoch = 0;
+	};
 
-		// First we check if there is a cached version of this triangle already waiting for us. If so, we can just do a super fast texture copy.
+	// Remembers what state the renderer was left in, so that setting it to what it already is doesn't cost a call. On the batching backends
+	// of SDL every state change is a command of its own, and even the software renderer validates the state every time it's set.
+	// Whatever we haven't set or read ourselves is unknown, and setting it always goes through. Everything is forgotten at the start of every
+	// frame and after user callbacks, since the application is free to change the state behind our back.
+	class RenderState
+	{
+	public:
+		// The state that Render changes, so that it can put it back the way it was at the end of the frame.
+		struct Snapshot
+		{
+			bool IsClipEnabled;
+			SDL_Rect Clip;
+			uint32_t DrawColor;
+			SDL_BlendMode BlendMode;
+			SDL_Texture* Target;
+		};
 
-		const auto key = std::make_tuple(
-			std::make_tuple(static_cast<int>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v1.pos.y)) - renderInfo.MinY, v1.uv.x, v1.uv.y, v1.col),
-			std::make_tuple(static_cast<int>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v2.pos.y)) - renderInfo.MinY, v2.uv.x, v2.uv.y, v2.col),
-			std::make_tuple(static_cast<int>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v3.pos.y)) - renderInfo.MinY, v3.uv.x, v3.uv.y, v3.col));
+		RenderState(SDL_Renderer* renderer, ImGuiSDL::FrameStats& stats) : Renderer(renderer), Stats(stats) { }
 
-		if (CurrentDevice->GenericTriangleCache.Contains(key))
+		void Forget()
 		{
-			const auto& cached = CurrentDevice->GenericTriangleCache.At(key);
-			DrawCachedTriangle(*cached, renderInfo);
-
-			return;
+			IsClipKnown = IsDrawColorKnown = IsBlendModeKnown = IsTargetKnown = false;
+			ColorMods.clear();
 		}
 
-		const InterpolatedFactorEquation<float> textureU(v1.uv.x, v2.uv.x, v3.uv.x, v1.pos, v2.pos, v3.pos);
-		const InterpolatedFactorEquation<float> textureV(v1.uv.y, v2.uv.y, v3.uv.y, v1.pos, v2.pos, v3.pos);
-
-		const InterpolatedFactorEquation<Color> shadeColor(Color(v1.col), Color(v2.col), Color(v3.col), v1.pos, v2.pos, v3.pos);
+		// Reads the state of the renderer. Reading doesn't queue any commands, and afterwards all of it is known.
+		Snapshot Capture()
+		{
+			Snapshot snapshot;
 
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
-		DrawTriangleWithColorFunction(renderInfo, [&](float x, float y) {
-			const float u = textureU.Evaluate(x, y);
-			const float v = textureV.Evaluate(x, y);
-			const Color sampled = texture->Sample(u, v);
-			const Color shade = shadeColor.Evaluate(x, y);
+			snapshot.IsClipEnabled = SDL_RenderIsClipEnabled(Renderer) == SDL_TRUE;
+			SDL_RenderGetClipRect(Renderer, &snapshot.Clip);
 
-			return sampled * shade;
-		}, cached.get());
+			Uint8 r, g, b, a;
+			SDL_GetRenderDrawColor(Renderer, &r, &g, &b, &a);
+			snapshot.DrawColor = static_cast<uint32_t>(r) | static_cast<uint32_t>(g) << 8 | static_cast<uint32_t>(b) << 16 | static_cast<uint32_t>(a) << 24;
 
-		if (!cached->Texture) return;
+			SDL_GetRenderDrawBlendMode(Renderer, &snapshot.BlendMode);
+			snapshot.Target = SDL_GetRenderTarget(Renderer);
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+			IsClipKnown = IsDrawColorKnown = IsBlendModeKnown = IsTargetKnown = true;
+			IsClipEnabled = snapshot.IsClipEnabled;
+			Clip = snapshot.Clip;
+			DrawColor = snapshot.DrawColor;
+			BlendMode = snapshot.BlendMode;
+			Target = snapshot.Target;
 
-		CurrentDevice->GenericTriangleCache.Insert(key, std::move(cached));
-	}
+			return snapshot;
+		}
 
-	void DrawUniformColorTriangle(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3)
+		void Restore(const Snapshot& snapshot)
+		{
+			SetTarget(snapshot.Target);
+			SetClipRect(snapshot.IsClipEnabled ? &snapshot.Clip : nullptr);
+			SetDrawColor(snapshot.DrawColor);
+			SetBlendMode(snapshot.BlendMode);
+		}
+
+		// A null rect disables clipping.
+		void SetClipRect(const SDL_Rect* rect)
+		{
+			const bool isEnabled = rect != nullptr;
+			if (IsClipKnown && isEnabled == IsClipEnabled && (!isEnabled || IsSameRect(*rect, Clip)))
+			{
+				Stats.ElidedSDLCalls++;
+				return;
+			}
+
+			SDL_RenderSetClipRect(Renderer, rect);
+			Stats.SDLCalls++;
+
+			IsClipKnown = true;
+			IsClipEnabled = isEnabled;
+			if (isEnabled) Clip = *rect;
+		}
+
+		void SetDrawColor(uint32_t color)
+		{
+			if (IsDrawColorKnown && color == DrawColor)
+			{
+				Stats.ElidedSDLCalls++;
+				return;
+			}
+
+			SDL_SetRenderDrawColor(Renderer, color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24);
+			Stats.SDLCalls++;
+
+			IsDrawColorKnown = true;
+			DrawColor = color;
+		}
+
+		void SetBlendMode(SDL_BlendMode mode)
+		{
+			if (IsBlendModeKnown && mode == BlendMode)
+			{
+				Stats.ElidedSDLCalls++;
+				return;
+			}
+
+			SDL_SetRenderDrawBlendMode(Renderer, mode);
+			Stats.SDLCalls++;
+
+			IsBlendModeKnown = true;
+			BlendMode = mode;
+		}
+
+		void SetTarget(SDL_Texture* target)
+		{
+			ForgetDestroyedTextures();
+			if (IsTargetKnown && target == Target)
+			{
+				Stats.ElidedSDLCalls++;
+				return;
+			}
+
+			SDL_SetRenderTarget(Renderer, target);
+			Stats.SDLCalls++;
+
+			// SDL keeps a separate clip rect for the window and resets it for texture targets, so after a switch we don't know what it is.
+			IsClipKnown = false;
+			IsTargetKnown = true;
+			Target = target;
+		}
+
+		// The color mod is state of the texture rather than of the renderer, so it's remembered for each texture. The alpha of the color is
+		// ignored, like SDL_SetTextureColorMod does.
+		void SetTextureColorMod(SDL_Texture* texture, uint32_t color)
+		{
+			color &= 0x00ffffff;
+			ForgetDestroyedTextures();
+
+			// A frame only ever uses a handful of textures, so a linear search is all this needs.
+			auto known = std::find_if(ColorMods.begin(), ColorMods.end(), [texture](const std::pair<SDL_Texture*, uint32_t>& mod) { return mod.first == texture; });
+			if (known != ColorMods.end() && known->second == color)
+			{
+				Stats.ElidedSDLCalls++;
+				return;
+			}
+
+			SDL_SetTextureColorMod(texture, color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff);
+			Stats.SDLCalls++;
+
+			if (known != ColorMods.end()) known->second = color;
+			else ColorMods.emplace_back(texture, color);
+		}
+	private:
+		static bool IsSameRect(const SDL_Rect& a, const SDL_Rect& b)
+		{
+			return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+		}
+
+		// Once a texture has been made, a texture we remember may have been destroyed and the new one made in its place, which doesn't
+		// have any of the state we remember for the old one. Nothing tells us which textures were destroyed, so all of it is forgotten.
+		void ForgetDestroyedTextures()
+		{
+			const unsigned int creations = TextureCreations;
+			if (creations == KnownTextureCreations) return;
+
+			KnownTextureCreations = creations;
+			ColorMods.clear();
+			if (Target) IsTargetKnown = false;
+		}
+
+		SDL_Renderer* Renderer;
+		ImGuiSDL::FrameStats& Stats;
+
+		bool IsClipKnown = false, IsDrawColorKnown = false, IsBlendModeKnown = false, IsTargetKnown = false;
+		bool IsClipEnabled = false;
+		SDL_Rect Clip = { 0, 0, 0, 0 };
+		uint32_t DrawColor = 0;
+		SDL_BlendMode BlendMode = SDL_BLENDMODE_NONE;
+		SDL_Texture* Target = nullptr;
+		std::vector<std::pair<SDL_Texture*, uint32_t>> ColorMods;
+		unsigned int KnownTextureCreations = 0;
+	};
+
+	// Collects runs of rectangles that can be submitted together. Consecutive fills of the same color become a single SDL_RenderFillRects,
+	// and consecutive copies of the same texture with the same color only set the color mod once, which lets SDL batch the copies.
+	// Anything that isn't a rectangle has to flush the batch first so that the painter's order is preserved.
+	class RectangleBatch
+	{
+	public:
+		RectangleBatch(SDL_Renderer* renderer, RenderState& state, ImGuiSDL::FrameStats& stats) : Renderer(renderer), State(state), Stats(stats) { }
+
+		void AddFill(const SDL_Rect& destination, uint32_t color)
+		{
+			if (CurrentKind != Kind::Fill || CurrentColor != color)
+			{
+				Flush();
+				CurrentKind = Kind::Fill;
+				CurrentColor = color;
+			}
+
+			Destinations.push_back(destination);
+		}
+
+		void AddCopy(SDL_Texture* texture, const SDL_Rect& source, const SDL_Rect& destination, SDL_RendererFlip flip, uint32_t color)
+		{
+			if (CurrentKind != Kind::Copy || CurrentTexture != texture || CurrentColor != color)
+			{
+				Flush();
+				CurrentKind = Kind::Copy;
+				CurrentTexture = texture;
+				CurrentColor = color;
+			}
+
+			Destinations.push_back(destination);
+			Sources.push_back(source);
+			Flips.push_back(flip);
+		}
+
+		// Copies of cached triangles out of an atlas page. The pages never get a color mod, so these don't set one.
+		void AddAtlasCopy(SDL_Texture* texture, const SDL_Rect& source, const SDL_Rect& destination)
+		{
+			if (CurrentKind != Kind::AtlasCopy || CurrentTexture != texture)
+			{
+				Flush();
+				CurrentKind = Kind::AtlasCopy;
+				CurrentTexture = texture;
+			}
+
+			Destinations.push_back(destination);
+			Sources.push_back(source);
+			Flips.push_back(SDL_FLIP_NONE);
+		}
+
+		void Flush()
+		{
+			if (Destinations.empty()) return;
+
+			const uint32_t color = Color(CurrentColor).ToBytes();
+			if (CurrentKind == Kind::Fill)
+			{
+				State.SetDrawColor(color);
+				SDL_RenderFillRects(Renderer, Destinations.data(), static_cast<int>(Destinations.size()));
+				Stats.SDLCalls++;
+			}
+			else
+			{
+				if (CurrentKind == Kind::Copy) State.SetTextureColorMod(CurrentTexture, color);
+				for (std::size_t i = 0; i < Destinations.size(); i++)
+				{
+					SDL_RenderCopyEx(Renderer, CurrentTexture, &Sources[i], &Destinations[i], 0.0, nullptr, Flips[i]);
+				}
+				Stats.SDLCalls += static_cast<int>(Destinations.size());
+			}
+
+			Destinations.clear();
+			Sources.clear();
+			Flips.clear();
+			CurrentKind = Kind::None;
+		}
+	private:
+		enum class Kind { None, Fill, Copy, AtlasCopy };
+
+		SDL_Renderer* Renderer;
+		RenderState& State;
+		ImGuiSDL::FrameStats& Stats;
+
+		Kind CurrentKind = Kind::None;
+		uint32_t CurrentColor = 0;
+		SDL_Texture* CurrentTexture = nullptr;
+
+		// The vectors keep their capacity between flushes, so after the first few frames batching doesn't allocate.
+		std::vector<SDL_Rect> Destinations;
+		std::vector<SDL_Rect> Sources;
+		std::vector<SDL_RendererFlip> Flips;
+	};
+
+	// Holds back the draws of a command, so that they can be submitted grouped by texture and color instead of in their original order. A draw
+	// only moves ahead of the draws between it and its group if it doesn't overlap any of them, so what ends up on the screen stays exactly
+	// the same. This turns text in alternating colors, or rows of backgrounds and borders, into a few long batches instead of many short ones.
+	class DrawReorderer
+	{
+	public:
+		struct Draw
+		{
+			enum class DrawKind { Fill, Copy, AtlasCopy } Kind;
+			SDL_Texture* Texture;
+			uint32_t Color;
+			SDL_Rect Source, Destination;
+			SDL_RendererFlip Flip;
+		};
+
+		void Add(const Draw& draw)
+		{
+			const std::size_t index = Draws.size();
+			Draws.push_back(Link{ draw, None });
+
+			// Walks back over the groups until one takes the draw, or one overlaps it and the draw can't move past it.
+			for (std::size_t i = Groups.size(); i-- > 0 && Groups.size() - i <= MaxLookBack;)
+			{
+				Group& group = Groups[i];
+				if (group.Kind == draw.Kind && group.Texture == draw.Texture && group.Color == draw.Color)
+				{
+					Draws[group.Last].Next = index;
+					group.Last = index;
+					SDL_UnionRect(&group.Bounds, &draw.Destination, &group.Bounds);
+					return;
+				}
+
+				if (SDL_HasIntersection(&group.Bounds, &draw.Destination)) break;
+			}
+
+			Groups.push_back(Group{ draw.Kind, draw.Texture, draw.Color, draw.Destination, index, index });
+		}
+
+		// Hands the draws over to the batch in their new order.
+		void Submit(RectangleBatch& batch)
+		{
+			for (const Group& group : Groups)
+			{
+				for (std::size_t i = group.First; i != None; i = Draws[i].Next)
+				{
+					const Draw& draw = Draws[i].Value;
+					switch (draw.Kind)
+					{
+					case Draw::DrawKind::Fill: batch.AddFill(draw.Destination, draw.Color); break;
+					case Draw::DrawKind::Copy: batch.AddCopy(draw.Texture, draw.Source, draw.Destination, draw.Flip, draw.Color); break;
+					case Draw::DrawKind::AtlasCopy: batch.AddAtlasCopy(draw.Texture, draw.Source, draw.Destination); break;
+					}
+				}
+			}
+
+			Draws.clear();
+			Groups.clear();
+		}
+	private:
+		// Every group that a draw has to look past makes adding it slower, and groups much further back than this rarely take anything.
+		static constexpr std::size_t MaxLookBack = 16;
+		static constexpr std::size_t None = static_cast<std::size_t>(-1);
+
+		// The draws of a group are linked in their original order, so that groups don't need a vector of their own.
+		struct Link
+		{
+			Draw Value;
+			std::size_t Next;
+		};
+
+		struct Group
+		{
+			Draw::DrawKind Kind;
+			SDL_Texture* Texture;
+			uint32_t Color;
+			SDL_Rect Bounds;
+			std::size_t First, Last;
+		};
+
+		std::vector<Link> Draws;
+		std::vector<Group> Groups;
+	};
+
+	// Runs a batch of independent jobs on a fixed set of worker threads. The calling thread works on the jobs too, so a pool with a thread
+	// count of one doesn't start any threads at all.
+	class WorkerPool
+	{
+	public:
+		WorkerPool() = default;
+		~WorkerPool() { SetThreadCount(1); }
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		int GetThreadCount() const { return static_cast<int>(Workers.size()) + 1; }
+
+		void SetThreadCount(int count)
+		{
+			if (std::max(count, 1) == GetThreadCount()) return;
+
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Stopping = true;
+			}
+			WorkAvailable.notify_all();
+			for (auto& worker : Workers) worker.join();
+			Workers.clear();
+
+			Stopping = false;
+			for (int i = 1; i < count; i++) Workers.emplace_back([this] { WorkerLoop(); });
+		}
+
+		// Calls job once for every index in [0, jobCount) and returns when all of them are done. Which thread runs which index is
+		// unspecified, so the jobs must not depend on each other.
+		void Run(std::size_t jobCount, const std::function<void(std::size_t)>& job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+				Job = &job;
+				JobCount = jobCount;
+				NextJob = 0;
+				ActiveWorkers = Workers.size();
+				Generation++;
+			}
+			WorkAvailable.notify_all();
+
+			Work(job, jobCount);
+
+			std::unique_lock<std::mutex> lock(Mutex);
+			WorkDone.wait(lock, [this] { return ActiveWorkers == 0; });
+			Job = nullptr;
+		}
+	private:
+		void Work(const std::function<void(std::size_t)>& job, std::size_t jobCount)
+		{
+			for (std::size_t i = NextJob++; i < jobCount; i = NextJob++) job(i);
+		}
+
+		void WorkerLoop()
+		{
+			unsigned int seenGeneration = 0;
+			for (;;)
+			{
+				const std::function<void(std::size_t)>* job;
+				std::size_t jobCount;
+				{
+					std::unique_lock<std::mutex> lock(Mutex);
+					WorkAvailable.wait(lock, [&] { return Stopping || Generation != seenGeneration; });
+					if (Stopping) return;
+
+					seenGeneration = Generation;
+					job = Job;
+					jobCount = JobCount;
+				}
+
+				Work(*job, jobCount);
+
+				std::lock_guard<std::mutex> lock(Mutex);
+				if (--ActiveWorkers == 0) WorkDone.notify_one();
+			}
+		}
+
+		std::vector<std::thread> Workers;
+
+		std::mutex Mutex;
+		std::condition_variable WorkAvailable;
+		std::condition_variable WorkDone;
+
+		const std::function<void(std::size_t)>* Job = nullptr;
+		std::size_t JobCount = 0;
+		std::atomic<std::size_t> NextJob{ 0 };
+		std::size_t ActiveWorkers = 0;
+		unsigned int Generation = 0;
+		bool Stopping = false;
+	};
+
+	// A whole file mapped into memory for reading. The pages are only read from the disk when they are first touched.
+#if defined(_WIN32)
+	// The wide version of a UTF-8 path, or an empty one if it isn't valid UTF-8.
+	std::vector<wchar_t> WidePath(const char* path)
+	{
+		const int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+		if (length <= 0) return std::vector<wchar_t>();
+
+		std::vector<wchar_t> widePath(static_cast<std::size_t>(length));
+		MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath.data(), length);
+		return widePath;
+	}
+#endif
+
+	// Puts a file in the place of another one in a single step, so that whoever has the old one open or mapped keeps reading what it was.
+	// Windows refuses to replace a file that is mapped, and then the old file stays as it was.
+	bool MoveFileOver(const char* source, const char* destination)
+	{
+#if defined(_WIN32)
+		const std::vector<wchar_t> wideSource = WidePath(source), wideDestination = WidePath(destination);
+		return !wideSource.empty() && !wideDestination.empty() && MoveFileExW(wideSource.data(), wideDestination.data(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(source, destination) == 0;
+#endif
+	}
+
+	void DeleteFileAt(const char* path)
+	{
+#if defined(_WIN32)
+		const std::vector<wchar_t> widePath = WidePath(path);
+		if (!widePath.empty()) DeleteFileW(widePath.data());
+#else
+		std::remove(path);
+#endif
+	}
+
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// The path is UTF-8, like it is everywhere in SDL. Empty files can't be mapped, and fail to open like missing ones.
+		bool Open(const char* path)
+		{
+			Close();
+
+#if defined(_WIN32)
+			const std::vector<wchar_t> widePath = WidePath(path);
+			if (widePath.empty()) return false;
+
+			File = CreateFileW(widePath.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			LARGE_INTEGER size;
+			if (File != INVALID_HANDLE_VALUE && GetFileSizeEx(File, &size) && size.QuadPart > 0)
+			{
+				Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (Mapping) Data = static_cast<const unsigned char*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+				Size = static_cast<std::size_t>(size.QuadPart);
+			}
+#else
+			const int file = open(path, O_RDONLY);
+			if (file < 0) return false;
+
+			struct stat status;
+			if (fstat(file, &status) == 0 && status.st_size > 0)
+			{
+				void* data = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+				if (data != MAP_FAILED) Data = static_cast<const unsigned char*>(data);
+				Size = static_cast<std::size_t>(status.st_size);
+			}
+
+			// The mapping stays valid without the file descriptor.
+			close(file);
+#endif
+
+			if (!Data) Close();
+			return Data != nullptr;
+		}
+
+		void Close()
+		{
+#if defined(_WIN32)
+			if (Data) UnmapViewOfFile(Data);
+			if (Mapping) CloseHandle(Mapping);
+			if (File != INVALID_HANDLE_VALUE) CloseHandle(File);
+			Mapping = nullptr;
+			File = INVALID_HANDLE_VALUE;
+#else
+			if (Data) munmap(const_cast<unsigned char*>(Data), Size);
+#endif
+			Data = nullptr;
+			Size = 0;
+		}
+
+		const unsigned char* GetData() const { return Data; }
+		std::size_t GetSize() const { return Size; }
+	private:
+		const unsigned char* Data = nullptr;
+		std::size_t Size = 0;
+#if defined(_WIN32)
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+#endif
+	};
+
+	// The font atlas of ImGui, both as an SDL texture for drawing rectangles out of it and as a surface the rasterizer can sample. The surface
+	// is a copy of its own, since building the atlas again frees the pixels of ImGui, and Prepare may still sample the old font then.
+	struct Texture
+	{
+		SDL_Surface* Surface;
+		SDL_Texture* Source;
+		std::vector<uint32_t> Pixels;
+
+		// The texture coordinates of the white pixel in the atlas, used for untextured triangles.
+		ImVec2 WhitePixel;
+
+		// The font atlas is normally white everywhere with the glyphs only in the alpha channel. In that case the rasterizer samples this
+		// 8 bit copy of the alpha channel instead of the full texture.
+		bool IsAlphaOnly = false;
+		std::vector<uint8_t> Alpha;
+
+		Texture(SDL_Renderer* renderer, ImFontAtlas* fonts) { Load(renderer, fonts); }
+		~Texture() { Release(); }
+
+		Texture(const Texture&) = delete;
+		Texture& operator=(const Texture&) = delete;
+
+		// Makes a new copy of the atlas, after it was built again.
+		void Reload(SDL_Renderer* renderer, ImFontAtlas* fonts)
+		{
+			Release();
+			Load(renderer, fonts);
+		}
+
+		// Whether this is a copy of what the atlas holds now. An atlas that was built again may well land in the same memory with the same
+		// size, so the pixels themselves are compared. That's a single pass over the atlas, which costs much less than drawing a frame.
+		// Asking ImGui for the pixels may build the atlas, so this is only called on the thread that uses ImGui.
+		bool IsCopyOf(ImFontAtlas* fonts) const
+		{
+			unsigned char* pixels;
+			int width, height;
+			fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+			return width == Surface->w && height == Surface->h
+				&& fonts->TexUvWhitePixel.x == WhitePixel.x && fonts->TexUvWhitePixel.y == WhitePixel.y
+				&& std::memcmp(pixels, Pixels.data(), Pixels.size() * sizeof(uint32_t)) == 0;
+		}
+
+		void Load(SDL_Renderer* renderer, ImFontAtlas* fonts)
+		{
+			unsigned char* pixels;
+			int width, height;
+			fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+			Pixels.resize(static_cast<std::size_t>(width) * height);
+			std::memcpy(Pixels.data(), pixels, Pixels.size() * sizeof(uint32_t));
+
+			static constexpr uint32_t rmask = 0x000000ff, gmask = 0x0000ff00, bmask = 0x00ff0000, amask = 0xff000000;
+			Surface = SDL_CreateRGBSurfaceFrom(Pixels.data(), width, height, 32, 4 * width, rmask, gmask, bmask, amask);
+
+			// Contexts that only draw into framebuffers don't have a renderer to make the texture with.
+			Source = renderer ? CreateTextureFromSurface(renderer, Surface) : nullptr;
+			WhitePixel = fonts->TexUvWhitePixel;
+			CreateAlphaCopy();
+		}
+
+		void Release()
+		{
+			SDL_FreeSurface(Surface);
+			if (Source) SDL_DestroyTexture(Source);
+			Alpha.clear();
+		}
+
+		void CreateAlphaCopy()
+		{
+			const uint32_t* pixels = static_cast<const uint32_t*>(Surface->pixels);
+			const std::size_t count = static_cast<std::size_t>(Surface->w) * Surface->h;
+
+			IsAlphaOnly = std::all_of(pixels, pixels + count, [](uint32_t pixel) { return (pixel & 0x00ffffff) == 0x00ffffff; });
+			if (!IsAlphaOnly) return;
+
+			Alpha.resize(count);
+			for (std::size_t i = 0; i < count; i++) Alpha[i] = static_cast<uint8_t>(pixels[i] >> 24);
+		}
+
+		uint32_t TexelAt(int x, int y) const { return static_cast<const uint32_t*>(Surface->pixels)[y * Surface->w + x]; }
+		uint8_t AlphaAt(int x, int y) const { return Alpha[y * Surface->w + x]; }
+	};
+
+	// The colors of the corners of a rectangle with a gradient, indexed so that bit 0 is set for the right corners and bit 1 for the
+	// bottom ones. That makes them the texels of a 2x2 texture in the right order, too.
+	using GradientCorners = std::array<uint32_t, 4>;
+
+	// Draws into memory the application gave us instead of through a renderer. See ImGuiSDL::Framebuffer. This does what SDL does for the
+	// fills and copies of the rectangle drawer and for the copies of rasterized triangles, blending the same way SDL_BLENDMODE_BLEND does.
+	// Everything is clipped to the clip rect, which is always kept within the framebuffer.
+	class FramebufferTarget
+	{
+	public:
+		explicit FramebufferTarget(const ImGuiSDL::Framebuffer& framebuffer)
+			: Pixels(static_cast<unsigned char*>(framebuffer.Pixels)), Pitch(framebuffer.Pitch), Bounds{ 0, 0, framebuffer.Width, framebuffer.Height }, Clip(Bounds) { }
+
+		// An empty rect means no clipping, like it does for SDL_RenderSetClipRect.
+		void SetClipRect(const SDL_Rect& rect)
+		{
+			if (rect.w <= 0 || rect.h <= 0) Clip = Bounds;
+			else if (!SDL_IntersectRect(&rect, &Bounds, &Clip)) Clip = { 0, 0, 0, 0 };
+		}
+
+		// The pixels that can still be drawn, which is the clip rect within the framebuffer.
+		const SDL_Rect& GetClipRect() const { return Clip; }
+
+		// Opaque fills are just a run of stores per row, and only translucent ones have to be blended pixel by pixel.
+		void Fill(const SDL_Rect& destination, uint32_t color)
+		{
+			SDL_Rect area;
+			if (!SDL_IntersectRect(&destination, &Clip, &area)) return;
+
+			for (int y = area.y; y < area.y + area.h; y++)
+			{
+				uint32_t* row = Row(y) + area.x;
+				if (color >> 24 == 0xff) std::fill_n(row, area.w, color);
+				else for (int x = 0; x < area.w; x++) Blend(row[x], color);
+			}
+		}
+
+		// Copies a part of the texture with the color mod SDL_SetTextureColorMod would apply, which leaves the alpha alone. Texels are
+		// picked with nearest sampling, and copies that aren't scaled, which is nearly all of the glyphs, walk the texture row by row.
+		void Copy(const Texture& texture, const SDL_Rect& source, const SDL_Rect& destination, SDL_RendererFlip flip, uint32_t color)
+		{
+			SDL_Rect area;
+			if (source.w <= 0 || source.h <= 0 || !SDL_IntersectRect(&destination, &Clip, &area)) return;
+
+			const uint32_t modR = color & 0xff, modG = (color >> 8) & 0xff, modB = (color >> 16) & 0xff;
+			const bool isUnscaled = source.w == destination.w && source.h == destination.h && flip == SDL_FLIP_NONE;
+
+			for (int y = area.y; y < area.y + area.h; y++)
+			{
+				int sourceY = source.y + static_cast<int>(static_cast<long long>(y - destination.y) * source.h / destination.h);
+				if (flip & SDL_FLIP_VERTICAL) sourceY = 2 * source.y + source.h - 1 - sourceY;
+				if (sourceY < 0 || sourceY >= texture.Surface->h) continue;
+
+				uint32_t* row = Row(y);
+				for (int x = area.x; x < area.x + area.w; x++)
+				{
+					int sourceX = isUnscaled ? source.x + (x - destination.x) : source.x + static_cast<int>(static_cast<long long>(x - destination.x) * source.w / destination.w);
+					if (flip & SDL_FLIP_HORIZONTAL) sourceX = 2 * source.x + source.w - 1 - sourceX;
+					if (sourceX < 0 || sourceX >= texture.Surface->w) continue;
+
+					const uint32_t texel = texture.TexelAt(sourceX, sourceY);
+					if (texel >> 24 == 0) continue;
+
+					const uint32_t modulated = Modulate(texel & 0xff, modR)
+						| Modulate((texel >> 8) & 0xff, modG) << 8
+						| Modulate((texel >> 16) & 0xff, modB) << 16
+						| (texel & 0xff000000);
+					Blend(row[x], modulated);
+				}
+			}
+		}
+
+		// Blends the corner colors over the rectangle the same way stretching the 2x2 gradient texture does, with the texel centers on the
+		// corners of the rectangle and every pixel sampled at its center.
+		void FillGradient(const SDL_Rect& destination, const GradientCorners& corners)
+		{
+			SDL_Rect area;
+			if (!SDL_IntersectRect(&destination, &Clip, &area)) return;
+
+			for (int y = area.y; y < area.y + area.h; y++)
+			{
+				const float v = (y - destination.y + 0.5f) / destination.h;
+				uint32_t* row = Row(y);
+				for (int x = area.x; x < area.x + area.w; x++)
+				{
+					const float u = (x - destination.x + 0.5f) / destination.w;
+
+					uint32_t color = 0;
+					for (int shift = 0; shift < 32; shift += 8)
+					{
+						const auto channel = [&](int corner) { return static_cast<float>((corners[corner] >> shift) & 0xff); };
+						const float top = channel(0) + (channel(1) - channel(0)) * u;
+						const float bottom = channel(2) + (channel(3) - channel(2)) * u;
+						color |= static_cast<uint32_t>(top + (bottom - top) * v + 0.5f) << shift;
+					}
+					Blend(row[x], color);
+				}
+			}
+		}
+
+		// Puts the pixels of a rasterized triangle at the given position. The pixels the triangle didn't cover are transparent and skipped.
+		void Copy(const uint32_t* pixels, int x, int y, int width, int height)
+		{
+			const SDL_Rect destination = { x, y, width, height };
+			SDL_Rect area;
+			if (!SDL_IntersectRect(&destination, &Clip, &area)) return;
+
+			for (int row = area.y; row < area.y + area.h; row++)
+			{
+				const uint32_t* source = pixels + static_cast<std::size_t>(row - y) * width + (area.x - x);
+				uint32_t* target = Row(row) + area.x;
+				for (int column = 0; column < area.w; column++) Blend(target[column], source[column]);
+			}
+		}
+	private:
+		uint32_t* Row(int y) const { return reinterpret_cast<uint32_t*>(Pixels + static_cast<std::ptrdiff_t>(y) * Pitch); }
+
+		static uint32_t Modulate(uint32_t a, uint32_t b) { return (a * b + 127) / 255; }
+
+		static void Blend(uint32_t& destination, uint32_t source)
+		{
+			const uint32_t alpha = source >> 24;
+			if (alpha == 0) return;
+			if (alpha == 0xff)
+			{
+				destination = source;
+				return;
+			}
+
+			uint32_t result = 0;
+			for (int shift = 0; shift < 24; shift += 8)
+			{
+				result |= (((source >> shift) & 0xff) * alpha + ((destination >> shift) & 0xff) * (0xff - alpha) + 127) / 255 << shift;
+			}
+			result |= (alpha + Modulate(destination >> 24, 0xff - alpha)) << 24;
+			destination = result;
+		}
+
+		unsigned char* Pixels;
+		int Pitch;
+		SDL_Rect Bounds;
+		SDL_Rect Clip;
+	};
+
+	// A run of triangles (a, b, c), (a, c, d), (a, d, e) and so on that all share their first vertex. This is how ImGui fills convex
+	// polygons, so circles, rounded corners and the like all come in as fans. Long fans are split into pieces of at most MaxTriangles
+	// triangles, which still share the first vertex.
+	struct TriangleFan
+	{
+		static constexpr unsigned int MaxTriangles = 30;
+
+		const ImDrawVert* Vertices;
+		const ImDrawIdx* Indices;
+		unsigned int TriangleCount;
+
+		unsigned int VertexCount() const { return TriangleCount + 2; }
+
+		// The outline of the polygon: the shared vertex, the two other vertices of the first triangle, and the last vertex of every
+		// triangle after that.
+		const ImDrawVert& Vertex(unsigned int n) const { return Vertices[Indices[n < 2 ? n : 3 * (n - 2) + 2]]; }
+	};
+
+	// The position and the texture coordinates of a vertex are next to each other in the default layout of ImDrawVert, so both can be
+	// loaded as four floats at once. Applications can change the layout, in which case bounding boxes are found one float at a time. This
+	// is a type rather than a bool, so that the layout picks the overload instead of a constant condition.
+	using IsPositionFollowedByUV = std::integral_constant<bool, offsetof(ImDrawVert, uv) == offsetof(ImDrawVert, pos) + sizeof(ImVec2)>;
+
+	struct Rect
+	{
+		float MinX, MinY, MaxX, MaxY;
+		float MinU, MinV, MaxU, MaxV;
+
+		bool IsOnExtreme(const ImVec2& point) const
+		{
+			return (point.x == MinX || point.x == MaxX) && (point.y == MinY || point.y == MaxY);
+		}
+
+		bool UsesOnlyColor(const ImVec2& whitePixel) const
+		{
+			return MinU == MaxU && MinU == whitePixel.x && MinV == MaxV && MaxV == whitePixel.y;
+		}
+
+		// Whether anything inside the rectangle can end up in the given pixels. Triangles cover the pixels whose centers are inside them,
+		// and rectangles are drawn from the pixel their minimum falls into, so a box that ends where the pixels start covers none of them.
+		bool Intersects(const SDL_Rect& pixels) const
+		{
+			return MaxX > pixels.x && MinX < pixels.x + pixels.w && MaxY > pixels.y && MinY < pixels.y + pixels.h;
+		}
+
+		// The pixels the rectangle covers on the screen, and the texels it covers in a texture of the given size.
+		SDL_Rect Destination() const
+		{
+			const SDL_Rect destination = {
+				static_cast<int>(MinX),
+				static_cast<int>(MinY),
+				static_cast<int>(MaxX - MinX),
+				static_cast<int>(MaxY - MinY)
+			};
+			return destination;
+		}
+
+		SDL_Rect Source(int textureWidth, int textureHeight) const
+		{
+			const SDL_Rect source = {
+				static_cast<int>(MinU * textureWidth),
+				static_cast<int>(MinV * textureHeight),
+				static_cast<int>((MaxU - MinU) * textureWidth),
+				static_cast<int>((MaxV - MinV) * textureHeight)
+			};
+			return source;
+		}
+
+		static SDL_RendererFlip Flip(bool doHorizontalFlip, bool doVerticalFlip)
+		{
+			return static_cast<SDL_RendererFlip>((doHorizontalFlip ? SDL_FLIP_HORIZONTAL : 0) | (doVerticalFlip ? SDL_FLIP_VERTICAL : 0));
+		}
+
+		static Rect CalculateBoundingBox(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2)
+		{
+			return CalculateBoundingBox(v0, v1, v2, IsPositionFollowedByUV());
+		}
+
+		static Rect CalculateBoundingBox(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2, std::true_type)
+		{
+#if defined(IMGUI_SDL_X86) && (defined(__SSE2__) || defined(_M_X64))
+			// The minimums and maximums of x, y, u and v all at once. The second operand is the one that wins a tie, so the earlier
+			// vertices go there to come out the same as with std::min and std::max.
+			const __m128 a = _mm_loadu_ps(&v0.pos.x);
+			const __m128 b = _mm_loadu_ps(&v1.pos.x);
+			const __m128 c = _mm_loadu_ps(&v2.pos.x);
+
+			float minimum[4], maximum[4];
+			_mm_storeu_ps(minimum, _mm_min_ps(c, _mm_min_ps(b, a)));
+			_mm_storeu_ps(maximum, _mm_max_ps(c, _mm_max_ps(b, a)));
+			return Rect{ minimum[0], minimum[1], maximum[0], maximum[1], minimum[2], minimum[3], maximum[2], maximum[3] };
+#elif defined(IMGUI_SDL_ARM64)
+			const float32x4_t a = vld1q_f32(&v0.pos.x);
+			const float32x4_t b = vld1q_f32(&v1.pos.x);
+			const float32x4_t c = vld1q_f32(&v2.pos.x);
+
+			float minimum[4], maximum[4];
+			vst1q_f32(minimum, vminq_f32(vminq_f32(a, b), c));
+			vst1q_f32(maximum, vmaxq_f32(vmaxq_f32(a, b), c));
+			return Rect{ minimum[0], minimum[1], maximum[0], maximum[1], minimum[2], minimum[3], maximum[2], maximum[3] };
+#else
+			return CalculateBoundingBox(v0, v1, v2, std::false_type());
+#endif
+		}
+
+		static Rect CalculateBoundingBox(const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2, std::false_type)
+		{
+			return Rect{
+				std::min({ v0.pos.x, v1.pos.x, v2.pos.x }),
+				std::min({ v0.pos.y, v1.pos.y, v2.pos.y }),
+				std::max({ v0.pos.x, v1.pos.x, v2.pos.x }),
+				std::max({ v0.pos.y, v1.pos.y, v2.pos.y }),
+				std::min({ v0.uv.x, v1.uv.x, v2.uv.x }),
+				std::min({ v0.uv.y, v1.uv.y, v2.uv.y }),
+				std::max({ v0.uv.x, v1.uv.x, v2.uv.x }),
+				std::max({ v0.uv.y, v1.uv.y, v2.uv.y })
+			};
+		}
+	};
+
+	// What the triangles of a draw list are drawn as. See PrimitiveStream.
+	enum class PrimitiveKind : uint8_t
+	{
+		Rectangle,
+		GradientRectangle,
+		Polygon,
+		UniformColorTriangle,
+		Triangle
+	};
+
+	// The triangles of a draw list, sorted out into the primitives they are drawn as. The primitives are kept as a structure of arrays,
+	// since culling only needs their bounds, and drawing mostly only their kind and where their indices start. A primitive points into the
+	// index buffer of its list instead of holding the vertices, so a list that is drawn with moved vertices, like into its retained texture,
+	// uses the same stream. The streams are kept from one frame to the next, so that their arrays don't have to grow again.
+	struct PrimitiveStream
+	{
+		// The primitives of a draw command, and where its gradient rectangles start in Gradients. Commands with user callbacks are empty.
+		struct CommandRange
+		{
+			uint32_t Begin, End, FirstGradient;
+		};
+
+		std::vector<PrimitiveKind> Kinds;
+		std::vector<uint32_t> FirstIndices;
+		// Two for rectangles, the length of the fan for polygons and one for triangles.
+		std::vector<uint8_t> TriangleCounts;
+		std::vector<Rect> Bounds;
+		// The corner colors of the gradient rectangles, in the order the rectangles come in.
+		std::vector<GradientCorners> Gradients;
+		std::vector<CommandRange> Commands;
+
+		// Whether the stream was built for the frame that is being drawn, or is left over from an earlier one.
+		bool IsClassified = false;
+
+		void Clear()
+		{
+			Kinds.clear();
+			FirstIndices.clear();
+			TriangleCounts.clear();
+			Bounds.clear();
+			Gradients.clear();
+			Commands.clear();
+			IsClassified = false;
+		}
+
+		void Add(PrimitiveKind kind, uint32_t firstIndex, unsigned int triangleCount, const Rect& bounds)
+		{
+			Kinds.push_back(kind);
+			FirstIndices.push_back(firstIndex);
+			TriangleCounts.push_back(static_cast<uint8_t>(triangleCount));
+			Bounds.push_back(bounds);
+		}
+
+		uint32_t Count() const { return static_cast<uint32_t>(Kinds.size()); }
+	};
+
+	static_assert(TriangleFan::MaxTriangles <= 255, "The triangle counts of primitives are stored in a byte.");
+
+	// Hashes the contents of draw lists to find the ones that didn't change since the last frame. The hash runs in two 64 bit lanes that
+	// take 128 bits of the list at a time: every block is mixed with a key that changes from block to block, multiplied from its halves and
+	// added to the lane, which is cheap and still depends on the order of the blocks. This only has to tell frames apart, not withstand
+	// anyone trying to break it, so the multiplication is the only thing that mixes the bits until the end.
+	struct DrawListHash
+	{
+		static constexpr uint64_t Steps[2] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full };
+
+		uint64_t Accumulators[2] = { 0x243f6a8885a308d3ull, 0x13198a2e03707344ull };
+		uint64_t Keys[2] = { 0xa4093822299f31d0ull, 0x082efa98ec4e6c89ull };
+
+		void Add(uint64_t low, uint64_t high)
+		{
+			const uint64_t data[2] = { low, high };
+			for (int lane = 0; lane < 2; lane++)
+			{
+				Keys[lane] += Steps[lane];
+				const uint64_t keyed = data[lane] ^ Keys[lane];
+				Accumulators[lane] += data[lane] + (keyed & 0xffffffff) * (keyed >> 32);
+			}
+		}
+
+		// Whatever doesn't fill a whole block is padded with zeros.
+		void AddBytes(const void* data, std::size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (; size > 0; size -= std::min<std::size_t>(size, 16), bytes += 16)
+			{
+				uint64_t block[2] = {};
+				std::memcpy(block, bytes, std::min<std::size_t>(size, 16));
+				Add(block[0], block[1]);
+			}
+		}
+
+		uint64_t Finish() const
+		{
+			uint64_t hash = Accumulators[0] ^ (Accumulators[1] << 29 | Accumulators[1] >> 35);
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdull;
+			hash ^= hash >> 33;
+			hash *= 0xc4ceb9fe1a85ec53ull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+	};
+
+	constexpr uint64_t DrawListHash::Steps[2];
+
+	uint64_t FloatBits(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	// The vertices are most of a draw list, so they get kernels of their own like the coverage test does. A vertex is hashed as one block of
+	// its position relative to the origin and its texture coordinates, and the colors of every four vertices as one more block. Positions
+	// are rounded to the 1/16 of a pixel the rasterizer works in first, as ImGui computes them from the position of the window, and a window
+	// that only moved would otherwise come out a bit different in the lowest bits. All of the kernels compute the same hash.
+	using VertexHashKernel = void (*)(DrawListHash& hash, const ImDrawVert* vertices, int count, const ImVec2& origin);
+
+	static constexpr float HashedPositionScale = 16.0f;
+
+	uint64_t QuantizePosition(float value, float origin)
+	{
+		return static_cast<uint32_t>(static_cast<int32_t>(std::lrint((value - origin) * HashedPositionScale)));
+	}
+
+	void HashVerticesScalar(DrawListHash& hash, const ImDrawVert* vertices, int count, const ImVec2& origin)
+	{
+		uint32_t colors[4] = {};
+		for (int i = 0; i < count; i++)
+		{
+			const ImDrawVert& vertex = vertices[i];
+			hash.Add(QuantizePosition(vertex.pos.x, origin.x) | QuantizePosition(vertex.pos.y, origin.y) << 32, FloatBits(vertex.uv.x) | FloatBits(vertex.uv.y) << 32);
+
+			colors[i % 4] = vertex.col;
+			if (i % 4 == 3 || i == count - 1)
+			{
+				hash.Add(colors[0] | static_cast<uint64_t>(colors[1]) << 32, colors[2] | static_cast<uint64_t>(colors[3]) << 32);
+				std::fill(colors, colors + 4, 0);
+			}
+		}
+	}
+
+#if defined(IMGUI_SDL_X86)
+	IMGUI_SDL_TARGET_SSE2 void HashVerticesSSE2(DrawListHash& hash, const ImDrawVert* vertices, int count, const ImVec2& origin)
+	{
+		const __m128 offset = _mm_setr_ps(origin.x, origin.y, 0.0f, 0.0f);
+		const __m128 scale = _mm_set1_ps(HashedPositionScale);
+		const __m128i positionMask = _mm_set_epi32(0, 0, -1, -1);
+		const __m128i step = _mm_set_epi64x(static_cast<long long>(DrawListHash::Steps[1]), static_cast<long long>(DrawListHash::Steps[0]));
+		__m128i accumulator = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hash.Accumulators));
+		__m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hash.Keys));
+
+		const auto add = [&](__m128i data) {
+			key = _mm_add_epi64(key, step);
+			const __m128i keyed = _mm_xor_si128(data, key);
+			accumulator = _mm_add_epi64(accumulator, _mm_add_epi64(data, _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32))));
+		};
+
+		for (int i = 0; i < count; i += 4)
+		{
+			const int group = std::min(4, count - i);
+			uint32_t colors[4] = {};
+			for (int j = 0; j < group; j++)
+			{
+				const ImDrawVert& vertex = vertices[i + j];
+				const __m128 values = _mm_sub_ps(_mm_setr_ps(vertex.pos.x, vertex.pos.y, vertex.uv.x, vertex.uv.y), offset);
+				const __m128i positions = _mm_cvtps_epi32(_mm_mul_ps(values, scale));
+				add(_mm_or_si128(_mm_and_si128(positionMask, positions), _mm_andnot_si128(positionMask, _mm_castps_si128(values))));
+				colors[j] = vertex.col;
+			}
+			add(_mm_loadu_si128(reinterpret_cast<const __m128i*>(colors)));
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(hash.Accumulators), accumulator);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(hash.Keys), key);
+	}
+#endif
+
+#if defined(IMGUI_SDL_ARM64)
+	void HashVerticesNEON(DrawListHash& hash, const ImDrawVert* vertices, int count, const ImVec2& origin)
+	{
+		const float offsetValues[4] = { origin.x, origin.y, 0.0f, 0.0f };
+		const float32x4_t offset = vld1q_f32(offsetValues);
+		const uint32_t positionMaskValues[4] = { 0xffffffff, 0xffffffff, 0, 0 };
+		const uint32x4_t positionMask = vld1q_u32(positionMaskValues);
+		const uint64x2_t step = vld1q_u64(DrawListHash::Steps);
+		uint64x2_t accumulator = vld1q_u64(hash.Accumulators);
+		uint64x2_t key = vld1q_u64(hash.Keys);
+
+		const auto add = [&](uint64x2_t data) {
+			key = vaddq_u64(key, step);
+			const uint64x2_t keyed = veorq_u64(data, key);
+			accumulator = vaddq_u64(accumulator, vaddq_u64(data, vmull_u32(vmovn_u64(keyed), vshrn_n_u64(keyed, 32))));
+		};
+
+		for (int i = 0; i < count; i += 4)
+		{
+			const int group = std::min(4, count - i);
+			uint32_t colors[4] = {};
+			for (int j = 0; j < group; j++)
+			{
+				const ImDrawVert& vertex = vertices[i + j];
+				const float valueArray[4] = { vertex.pos.x, vertex.pos.y, vertex.uv.x, vertex.uv.y };
+				const float32x4_t values = vsubq_f32(vld1q_f32(valueArray), offset);
+				const uint32x4_t positions = vreinterpretq_u32_s32(vcvtnq_s32_f32(vmulq_n_f32(values, HashedPositionScale)));
+				add(vreinterpretq_u64_u32(vbslq_u32(positionMask, positions, vreinterpretq_u32_f32(values))));
+				colors[j] = vertex.col;
+			}
+			add(vreinterpretq_u64_u32(vld1q_u32(colors)));
+		}
+
+		vst1q_u64(hash.Accumulators, accumulator);
+		vst1q_u64(hash.Keys, key);
+	}
+#endif
+
+	VertexHashKernel SelectVertexHashKernel()
+	{
+#if defined(IMGUI_SDL_X86)
+		if (SDL_HasSSE2()) return &HashVerticesSSE2;
+#elif defined(IMGUI_SDL_ARM64)
+		if (SDL_HasNEON()) return &HashVerticesNEON;
+#endif
+		return &HashVerticesScalar;
+	}
+
+	// Everything that decides what the list looks like: the vertices and clip rects relative to the origin, the indices, and the element
+	// counts and textures of the commands. The size the list is drawn at goes in as well.
+	uint64_t HashDrawList(const ImDrawList* commandList, const SDL_Rect& bounds)
+	{
+		static const VertexHashKernel hashVertices = SelectVertexHashKernel();
+
+		const ImVec2 origin(static_cast<float>(bounds.x), static_cast<float>(bounds.y));
+
+		DrawListHash hash;
+		hashVertices(hash, commandList->VtxBuffer.Data, commandList->VtxBuffer.Size, origin);
+		hash.AddBytes(commandList->IdxBuffer.Data, commandList->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+		for (const ImDrawCmd& drawCommand : commandList->CmdBuffer)
+		{
+			const ImVec4& clip = drawCommand.ClipRect;
+			hash.Add(FloatBits(clip.x - origin.x) | FloatBits(clip.y - origin.y) << 32, FloatBits(clip.z - origin.x) | FloatBits(clip.w - origin.y) << 32);
+			hash.Add(drawCommand.ElemCount, reinterpret_cast<uintptr_t>(drawCommand.TextureId));
+		}
+
+		hash.Add(static_cast<uint32_t>(bounds.w) | static_cast<uint64_t>(static_cast<uint32_t>(bounds.h)) << 32, commandList->CmdBuffer.Size);
+		return hash.Finish();
+	}
+
+	// A draw list that is drawn into a texture of its own, so that the frames where it doesn't change only have to copy the texture to the
+	// screen. The texture holds the list with its bounds moved to the top left corner, which is what lets it be reused wherever the list
+	// moves to. See ImGuiSDL::Options::RetainDrawLists.
+	struct RetainedDrawList
+	{
+		SDL_Texture* Texture = nullptr;
+		int TextureWidth = 0, TextureHeight = 0;
+
+		// The smallest size the texture couldn't be made in, if any, so that a list the renderer can't make a texture for isn't tried again
+		// every frame. Anything at least as big fails as well.
+		int FailedWidth = 0, FailedHeight = 0;
+
+		// The hash of what's in the texture. Only meaningful while IsValid is set.
+		uint64_t Hash = 0;
+		bool IsValid = false;
+
+		// The last frame the list was drawn in. Lists that weren't in a frame belong to windows that were closed or hidden.
+		unsigned int LastFrame = 0;
+
+		RetainedDrawList() = default;
+		RetainedDrawList(const RetainedDrawList&) = delete;
+		RetainedDrawList& operator=(const RetainedDrawList&) = delete;
+		~RetainedDrawList() { if (Texture) SDL_DestroyTexture(Texture); }
+
+		std::size_t Bytes() const { return static_cast<std::size_t>(TextureWidth) * TextureHeight * sizeof(uint32_t); }
+	};
+
+	// A texture that gets destroyed along with its owner, like the 2x2 textures gradient rectangles are stretched from. The gradient cache
+	// stores these by value, so they are move only.
+	struct OwnedTexture
+	{
+		SDL_Texture* Texture = nullptr;
+
+		OwnedTexture() = default;
+		OwnedTexture(OwnedTexture&& other) noexcept : Texture(other.Texture) { other.Texture = nullptr; }
+		OwnedTexture& operator=(OwnedTexture&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (Texture) SDL_DestroyTexture(Texture);
+				Texture = other.Texture;
+				other.Texture = nullptr;
+			}
+			return *this;
+		}
+		~OwnedTexture() { if (Texture) SDL_DestroyTexture(Texture); }
+	};
+
+	// What a frame does with one of its draw lists, decided before anything is drawn. Lists without a retained entry are drawn straight to
+	// the screen.
+	struct DrawListPlan
+	{
+		RetainedDrawList* Retained = nullptr;
+		SDL_Rect Bounds;
+		uint64_t Hash;
+		bool IsUnchanged;
+	};
+
+	// The keys of the triangle caches. Coordinates are 20 bits each, see PushRelativePosition.
+	// Uniform color is identified by its color and the coordinates of the edges: 32 bits of color and six coordinates.
+	using UniformColorTriangleKey = PackedKey<3>;
+	// The generic triangle cache unfortunately has to be basically a full representation of the triangle.
+	// This includes the (offset) vertex positions, texture coordinates and vertex colors, 136 bits per vertex.
+	using GenericTriangleKey = PackedKey<7>;
+	// Polygons are uniform color fans, identified by their color, vertex count and outline: 32 bits each for the color and the count,
+	// and two coordinates for each of up to TriangleFan::MaxTriangles + 2 vertices.
+	using PolygonKey = PackedKey<21>;
+
+	// The triangles that were rasterized in an earlier run. See ImGuiSDL::Options::CacheFilePath. The file starts with a header, followed by a
+	// record for every triangle: which cache it belongs in, its size, the words of its key and its pixels, padded to a multiple of 8 bytes.
+	// Opening the file only maps it and indexes the records, and the pixels of a triangle are read straight out of the mapping when it's
+	// drawn. Everything is in the byte order of the machine, so files from machines with another one are ignored along with those from
+	// other versions and font atlases.
+	class TriangleCacheFile
+	{
+	public:
+		enum class Kind : uint32_t { UniformColorTriangle, Triangle, Polygon };
+
+		// Bump this whenever the keys or the rasterizer change, so that old files don't hand out triangles that look different.
+		static constexpr uint32_t Version = 3;
+
+		struct StoredTriangle
+		{
+			const uint32_t* Pixels;
+			int Width, Height;
+		};
+
+		template <typename Key> using Index = std::unordered_map<Key, StoredTriangle, typename Key::Hasher>;
+
+		// The records of the file, by the kind of key of the cache they belong in.
+		Index<UniformColorTriangleKey> UniformColorTriangles;
+		Index<GenericTriangleKey> Triangles;
+		Index<PolygonKey> Polygons;
+
+		TriangleCacheFile() = default;
+		TriangleCacheFile(const TriangleCacheFile&) = delete;
+		TriangleCacheFile& operator=(const TriangleCacheFile&) = delete;
+
+		// Returns false if the file doesn't exist or can't be used, and then the indices are left empty.
+		bool Open(const char* path, uint64_t fontHash)
+		{
+			Close();
+			if (!File.Open(path)) return false;
+
+			if (!ReadIndices(fontHash))
+			{
+				Close();
+				return false;
+			}
+			return true;
+		}
+
+		void Close()
+		{
+			UniformColorTriangles.clear();
+			Triangles.clear();
+			Polygons.clear();
+			File.Close();
+		}
+
+		// Puts a new file together in memory. The records may be copied from the file that is open, as they are copied into the writer.
+		class Writer
+		{
+		public:
+			// The header is filled in when the file is saved, once the number of records is known.
+			explicit Writer(uint64_t fontHash) : FontHash(fontHash), Buffer(sizeof(Header)) { }
+
+			template <std::size_t WordCount> void Add(Kind kind, const PackedKey<WordCount>& key, int width, int height, const uint32_t* pixels, int pitch)
+			{
+				const RecordHeader record = { kind, static_cast<uint32_t>(WordCount), width, height };
+				Append(&record, sizeof(record));
+				Append(key.Words.data(), sizeof(key.Words));
+				for (int y = 0; y < height; y++) Append(pixels + static_cast<std::size_t>(y) * pitch, static_cast<std::size_t>(width) * sizeof(uint32_t));
+				Buffer.resize(Padded(Buffer.size()));
+
+				RecordCount++;
+				PixelBytes += static_cast<std::size_t>(width) * height * sizeof(uint32_t);
+			}
+
+			// The pixels of the records, which is what counts against the budget of the file.
+			std::size_t GetPixelBytes() const { return PixelBytes; }
+
+			// The file is written next to the old one and then moved over it, so that a failed write leaves the old file alone, and other
+			// contexts or processes that have the old one mapped don't see it change under them.
+			bool Save(const char* path)
+			{
+				const Header header = MakeHeader(FontHash, RecordCount);
+				std::memcpy(Buffer.data(), &header, sizeof(header));
+
+				const std::string temporaryPath = std::string(path) + ".tmp";
+				SDL_RWops* file = SDL_RWFromFile(temporaryPath.c_str(), "wb");
+				if (!file) return false;
+
+				const bool isWritten = SDL_RWwrite(file, Buffer.data(), 1, Buffer.size()) == Buffer.size();
+				if (SDL_RWclose(file) == 0 && isWritten && MoveFileOver(temporaryPath.c_str(), path)) return true;
+
+				DeleteFileAt(temporaryPath.c_str());
+				return false;
+			}
+		private:
+			void Append(const void* data, std::size_t size)
+			{
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+				Buffer.insert(Buffer.end(), bytes, bytes + size);
+			}
+
+			uint64_t FontHash;
+			std::vector<unsigned char> Buffer;
+			uint64_t RecordCount = 0;
+			std::size_t PixelBytes = 0;
+		};
+	private:
+		struct Header
+		{
+			char Magic[8];
+			uint32_t Version;
+			uint32_t ByteOrder;
+			uint64_t FontHash;
+			uint64_t RecordCount;
+		};
+
+		struct RecordHeader
+		{
+			Kind RecordKind;
+			uint32_t WordCount;
+			int32_t Width, Height;
+		};
+
+		static Header MakeHeader(uint64_t fontHash, uint64_t recordCount)
+		{
+			Header header;
+			std::memcpy(header.Magic, "ImGuiSDL", sizeof(header.Magic));
+			header.Version = Version;
+			header.ByteOrder = 0x01020304;
+			header.FontHash = fontHash;
+			header.RecordCount = recordCount;
+			return header;
+		}
+
+		// Records are padded so that the next one starts 8 byte aligned, which keeps the pixels in the mapping aligned as well.
+		static std::size_t Padded(std::size_t size) { return (size + 7) & ~static_cast<std::size_t>(7); }
+
+		// Anything that doesn't add up makes the whole file count as unusable, since it was most likely cut short while being written.
+		bool ReadIndices(uint64_t fontHash)
+		{
+			const unsigned char* data = File.GetData();
+			const std::size_t size = File.GetSize();
+
+			Header header;
+			if (size < sizeof(header)) return false;
+			std::memcpy(&header, data, sizeof(header));
+
+			const Header expected = MakeHeader(fontHash, header.RecordCount);
+			if (std::memcmp(&header, &expected, sizeof(header)) != 0) return false;
+
+			std::size_t offset = sizeof(header);
+			for (uint64_t n = 0; n < header.RecordCount; n++)
+			{
+				RecordHeader record;
+				if (size - offset < sizeof(record)) return false;
+				std::memcpy(&record, data + offset, sizeof(record));
+				offset += sizeof(record);
+
+				// Triangles are never anywhere near 32k pixels in size, so anything bigger than that is garbage.
+				if (record.Width <= 0 || record.Height <= 0 || record.Width > 32767 || record.Height > 32767 || record.WordCount > sizeof(PolygonKey) / sizeof(uint64_t)) return false;
+
+				// The size is worked out in 64 bits, as the pixels of a record that big wouldn't fit into the size_t of a 32 bit build.
+				const std::size_t keyBytes = record.WordCount * sizeof(uint64_t);
+				const uint64_t pixelBytes = static_cast<uint64_t>(record.Width) * static_cast<uint64_t>(record.Height) * sizeof(uint32_t);
+				const uint64_t paddedBytes = (keyBytes + pixelBytes + 7) & ~static_cast<uint64_t>(7);
+				if (paddedBytes > static_cast<uint64_t>(size - offset)) return false;
+				const std::size_t recordBytes = static_cast<std::size_t>(paddedBytes);
+
+				const unsigned char* words = data + offset;
+				const StoredTriangle stored = { reinterpret_cast<const uint32_t*>(words + keyBytes), record.Width, record.Height };
+
+				bool isKnown = false;
+				switch (record.RecordKind)
+				{
+				case Kind::UniformColorTriangle: isKnown = AddToIndex(UniformColorTriangles, record.WordCount, words, stored); break;
+				case Kind::Triangle: isKnown = AddToIndex(Triangles, record.WordCount, words, stored); break;
+				case Kind::Polygon: isKnown = AddToIndex(Polygons, record.WordCount, words, stored); break;
+				}
+				if (!isKnown) return false;
+
+				offset += recordBytes;
+			}
+			return true;
+		}
+
+		template <std::size_t WordCount> static bool AddToIndex(Index<PackedKey<WordCount>>& index, uint32_t wordCount, const unsigned char* words, const StoredTriangle& stored)
+		{
+			if (wordCount != WordCount) return false;
+
+			PackedKey<WordCount> key;
+			std::memcpy(key.Words.data(), words, sizeof(key.Words));
+			index[key] = stored;
+			return true;
+		}
+
+		MappedFile File;
+	};
+
+	constexpr uint32_t TriangleCacheFile::Version;
+
+	struct Device
+	{
+		SDL_Renderer* Renderer;
+
+		// The font atlas the device was created for, and its own copy of the font texture. Draw commands that use the TexID of the atlas are
+		// drawn out of the copy, so devices on different renderers can share an atlas.
+		ImFontAtlas* Fonts;
+		Texture FontTexture;
+
+		// The cache stores these by value, so they are move only. Only triangles that were too big for the atlas own their texture.
+		struct TriangleCacheItem
+		{
+			TriangleAtlas::Location Location;
+			int Width = 0, Height = 0;
+
+			// Set on the items the prepass rasterized ahead of time, so that drawing them the first time still counts as the miss it was.
+			bool IsPendingMiss = false;
+
+			TriangleCacheItem() = default;
+			TriangleCacheItem(TriangleCacheItem&& other) noexcept
+				: Location(other.Location), Width(other.Width), Height(other.Height), IsPendingMiss(other.IsPendingMiss) { other.Location.Texture = nullptr; }
+			TriangleCacheItem& operator=(TriangleCacheItem&& other) noexcept
+			{
+				if (this != &other)
+				{
+					Release();
+					Location = other.Location;
+					Width = other.Width;
+					Height = other.Height;
+					IsPendingMiss = other.IsPendingMiss;
+					other.Location.Texture = nullptr;
+				}
+				return *this;
+			}
+			~TriangleCacheItem() { Release(); }
+
+			void Release()
+			{
+				if (Location.Page < 0 && Location.Texture) SDL_DestroyTexture(Location.Texture);
+				Location.Texture = nullptr;
+			}
+
+			// What the item costs against the budget of its cache.
+			std::size_t Bytes() const { return static_cast<std::size_t>(Width) * Height * sizeof(uint32_t); }
+		};
+
+		// The options the device was last configured with. See ApplyOptions.
+		ImGuiSDL::Options Configuration;
+
+		// The stats of the frame being rendered, and of the ones before it for the averages. See ImGuiSDL::GetFrameStats.
+		ImGuiSDL::FrameStats Stats;
+		static constexpr std::size_t StatsHistorySize = 60;
+		std::array<ImGuiSDL::FrameStats, StatsHistorySize> StatsHistory;
+		std::size_t StatsHistoryCount = 0;
+
+		// Holds the pixels of every cached triangle. Declared before the caches so that it outlives their items.
+		TriangleAtlas Atlas;
+
+		// The budgets of the caches start out as configured, but may move around between them. See AdaptCacheBudgets.
+		LRUCache<UniformColorTriangleKey, TriangleCacheItem> UniformColorTriangleCache;
+		LRUCache<GenericTriangleKey, TriangleCacheItem> GenericTriangleCache;
+		LRUCache<PolygonKey, TriangleCacheItem> PolygonCache;
+
+		// Gradients are identified by the colors of their four corners. Every gradient texture is the same four texels, so the budget of
+		// this cache is a number of textures instead of bytes, and it isn't configurable.
+		using GradientKey = PackedKey<2>;
+		static constexpr std::size_t MaxGradientTextures = 256;
+		LRUCache<GradientKey, OwnedTexture> GradientCache;
+
+		// The visible parts of big triangles that are mostly clipped away are drawn through this instead of the atlas, as they aren't cached.
+		// It grows to fit the biggest of them. See DrawVisiblePart.
+		OwnedTexture ClippedTexture;
+		int ClippedTextureWidth = 0, ClippedTextureHeight = 0;
+
+		// The pixels rasterized so far in the frame, out of ImGuiSDL::Options::RasterizationBudget. See TakeRasterizationBudget.
+		long long SpentRasterizationBudget = 0;
+
+		// The file the cached triangles are kept in between runs, if there is one. See ImGuiSDL::Options::CacheFilePath.
+		std::string CacheFilePath;
+		TriangleCacheFile CacheFile;
+
+		// Incremented every frame, used to figure out which atlas page has gone unused for the longest.
+		unsigned int Frame = 0;
+
+		// The draw data the last Prepare was for, until it gets rendered. See ImGuiSDL::Prepare.
+		const ImDrawData* PreparedDrawData = nullptr;
+		// The eviction counts of the caches when the stats of the frame were started. See StartFrameStats.
+		std::array<std::size_t, 3> InitialEvictions{};
+
+		// SDL_RenderGeometryRaw, if the SDL library we're running against has it. See LoadRenderGeometry.
+		using RenderGeometryRawFunction = int (SDLCALL*)(SDL_Renderer*, SDL_Texture*, const float*, int, const SDL_Color*, int, const float*, int, int, const void*, int, int);
+		RenderGeometryRawFunction RenderGeometryRaw = nullptr;
+
+		RenderState State;
+		RectangleBatch Rectangles;
+		DrawReorderer Reorderer;
+
+		// The lists that are drawn into textures of their own, and what the frame being rendered does with each of its lists. See
+		// PlanDrawLists. Cleared when the renderer turns out not to be able to draw into textures or blend them the way we need.
+		bool CanRetainDrawLists;
+		// Lists bigger than this are drawn directly. Never more than the renderer can make a texture of.
+		int MaxRetainedTextureWidth = 4096, MaxRetainedTextureHeight = 4096;
+		std::unordered_map<const ImDrawList*, RetainedDrawList> RetainedDrawLists;
+		std::vector<DrawListPlan> DrawListPlans;
+		// The vertices of the list that is being drawn into its texture, moved to the top left corner of the texture.
+		std::vector<ImDrawVert> TranslatedVertices;
+		// The primitives of every list of the frame, in the order of the lists. See ClassifyDrawList.
+		std::vector<PrimitiveStream> PrimitiveStreams;
+
+		// A triangle or polygon that missed the cache during the prepass of a frame, waiting to be rasterized by the worker pool. Only the
+		// vertices are stored; everything else is derived from them on the worker thread. Polygons point into the draw data, which stays
+		// alive until the frame has been rendered.
+		struct RasterizationJob
+		{
+			enum class JobKind { UniformColorTriangle, Triangle, Polygon } Kind;
+			UniformColorTriangleKey UniformColorKey;
+			GenericTriangleKey GenericKey;
+			PolygonKey OutlineKey;
+			ImDrawVert V1, V2, V3;
+			const Texture* SampledTexture;
+			TriangleFan Fan;
+
+			std::vector<uint32_t> Pixels;
+			bool IsCovered;
+		};
+
+		// Used for rasterizing the cache misses of a frame before it is drawn. See RasterizeMisses and UploadRasterizedMisses.
+		WorkerPool Workers;
+		std::vector<RasterizationJob> Jobs;
+		std::size_t JobCount = 0;
+		std::unordered_set<UniformColorTriangleKey, UniformColorTriangleKey::Hasher> QueuedUniformColorTriangles;
+		std::unordered_set<GenericTriangleKey, GenericTriangleKey::Hasher> QueuedGenericTriangles;
+		std::unordered_set<PolygonKey, PolygonKey::Hasher> QueuedPolygons;
+
+		Device(SDL_Renderer* renderer, ImFontAtlas* fonts, const ImGuiSDL::Options& options)
+			: Renderer(renderer), Fonts(fonts), FontTexture(renderer, fonts), Atlas(renderer, Stats),
+			UniformColorTriangleCache(options.UniformColorTriangleCacheBytes), GenericTriangleCache(options.GenericTriangleCacheBytes), PolygonCache(options.PolygonCacheBytes),
+			GradientCache(MaxGradientTextures),
+			RenderGeometryRaw(renderer ? LoadRenderGeometry() : nullptr), State(renderer, Stats), Rectangles(renderer, State, Stats),
+			CanRetainDrawLists(SDL_VERSION_ATLEAST(2, 0, 6) && renderer && SDL_RenderTargetSupported(renderer))
+		{
+			SDL_RendererInfo info;
+			if (renderer && SDL_GetRendererInfo(renderer, &info) == 0)
+			{
+				if (info.max_texture_width > 0) MaxRetainedTextureWidth = std::min(MaxRetainedTextureWidth, info.max_texture_width);
+				if (info.max_texture_height > 0) MaxRetainedTextureHeight = std::min(MaxRetainedTextureHeight, info.max_texture_height);
+			}
+
+			ApplyOptions(options);
+		}
+
+		~Device()
+		{
+			SaveCacheFile();
+		}
+
+		bool UseGeometry() const { return RenderGeometryRaw && Configuration.Mode != ImGuiSDL::RenderMode::Rasterizer; }
+
+		bool IsFontTexture(ImTextureID texture) const { return texture == Fonts->TexID; }
+
+		// Building the atlas again, to add a font say, makes our copy of it stale. Everything that was drawn out of the old copy goes along
+		// with it: the retained lists, the cached triangles that sample the font, and the triangles of the cache file, which was written for
+		// the old font. This asks ImGui for the atlas and destroys textures, so it's only called by Render, before the frame is planned.
+		// Returns true if the font was reloaded.
+		bool ReloadFontIfRebuilt()
+		{
+			if (FontTexture.IsCopyOf(Fonts)) return false;
+
+			IMGUI_SDL_TRACE_ZONE("Reload font");
+			FontTexture.Reload(Renderer, Fonts);
+			RetainedDrawLists.clear();
+			GenericTriangleCache.Clear();
+			if (!CacheFilePath.empty()) CacheFile.Open(CacheFilePath.c_str(), HashFont());
+			return true;
+		}
+
+		// Changing any of the cache budgets resets all of them to the configured ones, undoing whatever the adaptive sizing did to them.
+		void ApplyOptions(const ImGuiSDL::Options& options)
+		{
+			const bool budgetsChanged = options.UniformColorTriangleCacheBytes != Configuration.UniformColorTriangleCacheBytes
+				|| options.GenericTriangleCacheBytes != Configuration.GenericTriangleCacheBytes
+				|| options.PolygonCacheBytes != Configuration.PolygonCacheBytes;
+			Configuration = options;
+
+			Workers.SetThreadCount(options.RasterizerThreadCount > 0 ? options.RasterizerThreadCount : SDL_GetCPUCount());
+
+			if (budgetsChanged)
+			{
+				UniformColorTriangleCache.SetBudget(options.UniformColorTriangleCacheBytes);
+				GenericTriangleCache.SetBudget(options.GenericTriangleCacheBytes);
+				PolygonCache.SetBudget(options.PolygonCacheBytes);
+			}
+			Atlas.SetBudget(TotalCacheBudget());
+
+			// A prepared frame may have planned to use the retained lists, so it has to be prepared again.
+			if (!options.RetainDrawLists)
+			{
+				RetainedDrawLists.clear();
+				PreparedDrawData = nullptr;
+			}
+
+			// The file that is let go of gets written, so that switching to another one doesn't lose what was rasterized meanwhile.
+			const std::string cacheFilePath = options.CacheFilePath ? options.CacheFilePath : "";
+			if (cacheFilePath != CacheFilePath)
+			{
+				SaveCacheFile();
+				CacheFilePath = cacheFilePath;
+				if (!CacheFilePath.empty()) CacheFile.Open(CacheFilePath.c_str(), HashFont());
+			}
+			Atlas.SetKeepsPixels(!CacheFilePath.empty());
+		}
+
+		// The generic triangles sample the font, so a file written for another font would hand out the wrong glyphs.
+		uint64_t HashFont() const
+		{
+			const SDL_Surface* surface = FontTexture.Surface;
+
+			DrawListHash hash;
+			hash.Add(static_cast<uint64_t>(surface->w), static_cast<uint64_t>(surface->h));
+			hash.AddBytes(surface->pixels, static_cast<std::size_t>(surface->pitch) * surface->h);
+			return hash.Finish();
+		}
+
+		// Writes the cached triangles, from the most recently used ones down, and after them the ones of the old file that weren't drawn
+		// at all this time, as long as the pixels fit into the total budget of the caches. Triangles with a texture of their own and the ones
+		// whose pixels weren't kept aren't written.
+		void SaveCacheFile()
+		{
+			if (CacheFilePath.empty()) return;
+			IMGUI_SDL_TRACE_ZONE("Save cache file");
+
+			using Kind = TriangleCacheFile::Kind;
+			TriangleCacheFile::Writer writer(HashFont());
+
+			WriteCachedTriangles(writer, Kind::UniformColorTriangle, UniformColorTriangleCache, CacheFile.UniformColorTriangles);
+			WriteCachedTriangles(writer, Kind::Triangle, GenericTriangleCache, CacheFile.Triangles);
+			WriteCachedTriangles(writer, Kind::Polygon, PolygonCache, CacheFile.Polygons);
+			WriteStoredTriangles(writer, Kind::UniformColorTriangle, CacheFile.UniformColorTriangles);
+			WriteStoredTriangles(writer, Kind::Triangle, CacheFile.Triangles);
+			WriteStoredTriangles(writer, Kind::Polygon, CacheFile.Polygons);
+
+#if defined(_WIN32)
+			// Windows doesn't replace files that are mapped, and nothing is read from the old file anymore, as the writer has its own copy.
+			CacheFile.Close();
+#endif
+			writer.Save(CacheFilePath.c_str());
+		}
+
+		// Triangles that are in the cache now are taken out of the index of the old file, so that they aren't written twice.
+		template <typename Cache, typename Index> void WriteCachedTriangles(TriangleCacheFile::Writer& writer, TriangleCacheFile::Kind kind, const Cache& cache, Index& stored)
+		{
+			cache.ForEach([&](const typename Index::key_type& key, const TriangleCacheItem& item) {
+				int pitch;
+				const uint32_t* pixels = Atlas.PixelsAt(item.Location, pitch);
+				if (!pixels || writer.GetPixelBytes() + item.Bytes() > TotalCacheBudget()) return;
+
+				writer.Add(kind, key, item.Width, item.Height, pixels, pitch);
+				stored.erase(key);
+			});
+		}
+
+		template <typename Index> void WriteStoredTriangles(TriangleCacheFile::Writer& writer, TriangleCacheFile::Kind kind, const Index& stored)
+		{
+			for (const auto& entry : stored)
+			{
+				const TriangleCacheFile::StoredTriangle& triangle = entry.second;
+				const std::size_t bytes = static_cast<std::size_t>(triangle.Width) * triangle.Height * sizeof(uint32_t);
+				if (writer.GetPixelBytes() + bytes > TotalCacheBudget()) continue;
+
+				writer.Add(kind, entry.first, triangle.Width, triangle.Height, triangle.Pixels, triangle.Width);
+			}
+		}
+
+		std::size_t TotalCacheBudget() const
+		{
+			return Configuration.UniformColorTriangleCacheBytes + Configuration.GenericTriangleCacheBytes + Configuration.PolygonCacheBytes;
+		}
+
+		// We only get to use SDL_RenderGeometryRaw if the SDL version we are running against is 2.0.18 or newer. When we were compiled
+		// against older headers the function isn't declared at all, so then we look it up from the SDL library that SDL_GetVersion came
+		// from. Loading SDL by name instead could load a second copy of it next to a static, renamed or bundled one, and the renderer
+		// belongs to the first. A static SDL is as old as the headers, so it never has the function to find.
+		RenderGeometryRawFunction LoadRenderGeometry()
+		{
+			SDL_version version;
+			SDL_GetVersion(&version);
+			if (SDL_VERSIONNUM(version.major, version.minor, version.patch) < SDL_VERSIONNUM(2, 0, 18)) return nullptr;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+			return &SDL_RenderGeometryRaw;
+#else
+#if defined(_WIN32)
+			HMODULE module;
+			const DWORD flags = GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT;
+			if (!GetModuleHandleExW(flags, reinterpret_cast<LPCWSTR>(&SDL_GetVersion), &module)) return nullptr;
+			return reinterpret_cast<RenderGeometryRawFunction>(GetProcAddress(module, "SDL_RenderGeometryRaw"));
+#else
+			// RTLD_NOLOAD only hands out a library that is loaded already. It stays loaded after we let go of it, as we're linked to it.
+			Dl_info info;
+			if (!dladdr(reinterpret_cast<void*>(&SDL_GetVersion), &info) || !info.dli_fname) return nullptr;
+			void* library = dlopen(info.dli_fname, RTLD_LAZY | RTLD_NOLOAD);
+			if (!library) return nullptr;
+
+			void* function = dlsym(library, "SDL_RenderGeometryRaw");
+			dlclose(library);
+			return reinterpret_cast<RenderGeometryRawFunction>(function);
+#endif
+#endif
+		}
+
+		// Scratch memory the triangle rasterizer writes into before the result is uploaded to a texture. Kept around so that a frame full of
+		// cache misses doesn't reallocate it for every triangle.
+		std::vector<uint32_t> PixelBuffer;
+	};
+
+	// Needed before C++17 since std::min takes it by reference.
+	constexpr std::size_t Device::StatsHistorySize;
+	constexpr std::size_t Device::MaxGradientTextures;
+
+	struct FixedPointTriangleRenderInfo
+	{
+		int X1, X2, X3, Y1, Y2, Y3;
+		int MinX, MaxX, MinY, MaxY;
+
+		// Coordinates are in 1/16 of a pixel. The cache keys use this too, so they always agree with what gets rasterized.
+		static int ToFixedPoint(float value)
+		{
+			return static_cast<int>(std::round(value * 16.0f));
+		}
+
+		static FixedPointTriangleRenderInfo CalculateFixedPointTriangleInfo(const ImVec2& v1, const ImVec2& v2, const ImVec2& v3)
+		{
+			const int x1 = ToFixedPoint(v1.x);
+			const int x2 = ToFixedPoint(v2.x);
+			const int x3 = ToFixedPoint(v3.x);
+
+			const int y1 = ToFixedPoint(v1.y);
+			const int y2 = ToFixedPoint(v2.y);
+			const int y3 = ToFixedPoint(v3.y);
+
+			int minX = (std::min({ x1, x2, x3 }) + 0xF) >> 4;
+			int maxX = (std::max({ x1, x2, x3 }) + 0xF) >> 4;
+			int minY = (std::min({ y1, y2, y3 }) + 0xF) >> 4;
+			int maxY = (std::max({ y1, y2, y3 }) + 0xF) >> 4;
+
+			return FixedPointTriangleRenderInfo{ x1, x2, x3, y1, y2, y3, minX, maxX, minY, maxY };
+		}
+	};
+
+	// The rasterizer tests pixels in rows of up to 8 at a time. A kernel gets the values of the three edge functions at the first pixel of
+	// the row and, for every lane, how much each edge function has decreased by that pixel. It returns a mask with bit i set if pixel i
+	// is inside all three edges. There are vectorized versions of the kernel, and the best one the CPU supports is picked at runtime.
+	static constexpr int CoverageRowLength = 8;
+
+	struct EdgeLanes
+	{
+		alignas(32) int32_t Offsets[3][CoverageRowLength];
+	};
+
+	using CoverageKernel = uint32_t (*)(const int32_t edges[3], const EdgeLanes& lanes, int count);
+
+	uint32_t CalculateCoverageScalar(const int32_t edges[3], const EdgeLanes& lanes, int count)
+	{
+		uint32_t mask = 0;
+		for (int i = 0; i < count; i++)
+		{
+			if (edges[0] - lanes.Offsets[0][i] > 0 && edges[1] - lanes.Offsets[1][i] > 0 && edges[2] - lanes.Offsets[2][i] > 0) mask |= 1u << i;
+		}
+		return mask;
+	}
+
+#if defined(IMGUI_SDL_X86)
+	IMGUI_SDL_TARGET_SSE2 uint32_t CalculateCoverageSSE2(const int32_t edges[3], const EdgeLanes& lanes, int count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		__m128i inside0 = _mm_set1_epi32(-1);
+		__m128i inside1 = _mm_set1_epi32(-1);
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const __m128i value = _mm_set1_epi32(edges[edge]);
+			const __m128i* offsets = reinterpret_cast<const __m128i*>(lanes.Offsets[edge]);
+			inside0 = _mm_and_si128(inside0, _mm_cmpgt_epi32(_mm_sub_epi32(value, _mm_load_si128(offsets + 0)), zero));
+			inside1 = _mm_and_si128(inside1, _mm_cmpgt_epi32(_mm_sub_epi32(value, _mm_load_si128(offsets + 1)), zero));
+		}
+
+		const uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(inside0)))
+			| (static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(inside1))) << 4);
+		return mask & ((1u << count) - 1);
+	}
+
+	IMGUI_SDL_TARGET_AVX2 uint32_t CalculateCoverageAVX2(const int32_t edges[3], const EdgeLanes& lanes, int count)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+
+		__m256i inside = _mm256_set1_epi32(-1);
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const __m256i value = _mm256_set1_epi32(edges[edge]);
+			const __m256i offsets = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.Offsets[edge]));
+			inside = _mm256_and_si256(inside, _mm256_cmpgt_epi32(_mm256_sub_epi32(value, offsets), zero));
+		}
+
+		const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(inside)));
+		return mask & ((1u << count) - 1);
+	}
+#endif
+
+#if defined(IMGUI_SDL_ARM64)
+	uint32_t CalculateCoverageNEON(const int32_t edges[3], const EdgeLanes& lanes, int count)
+	{
+		const int32x4_t zero = vdupq_n_s32(0);
+
+		uint32x4_t inside0 = vdupq_n_u32(0xffffffff);
+		uint32x4_t inside1 = vdupq_n_u32(0xffffffff);
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const int32x4_t value = vdupq_n_s32(edges[edge]);
+			inside0 = vandq_u32(inside0, vcgtq_s32(vsubq_s32(value, vld1q_s32(lanes.Offsets[edge] + 0)), zero));
+			inside1 = vandq_u32(inside1, vcgtq_s32(vsubq_s32(value, vld1q_s32(lanes.Offsets[edge] + 4)), zero));
+		}
+
+		static const uint32_t bits0[4] = { 1, 2, 4, 8 };
+		static const uint32_t bits1[4] = { 16, 32, 64, 128 };
+		const uint32_t mask = vaddvq_u32(vandq_u32(inside0, vld1q_u32(bits0))) | vaddvq_u32(vandq_u32(inside1, vld1q_u32(bits1)));
+		return mask & ((1u << count) - 1);
+	}
+#endif
+
+	CoverageKernel SelectCoverageKernel()
+	{
+#if defined(IMGUI_SDL_X86)
+		if (SDL_HasAVX2()) return &CalculateCoverageAVX2;
+		if (SDL_HasSSE2()) return &CalculateCoverageSSE2;
+#elif defined(IMGUI_SDL_ARM64)
+		if (SDL_HasNEON()) return &CalculateCoverageNEON;
+#endif
+		return &CalculateCoverageScalar;
+	}
+
+	// The edge functions of a triangle, which the rasterizer is built on. Pixel (x, y) is inside the triangle when C + DeltaX * (y << 4) -
+	// DeltaY * (x << 4) is positive for all three edges.
+	// Implementation source: https://web.archive.org/web/20171128164608/http://forum.devmaster.net/t/advanced-rasterization/6145.
+	// This is a fixed point implementation that rounds to top-left.
+	struct EdgeFunctions
+	{
+		int DeltaX[3], DeltaY[3], C[3];
+
+		explicit EdgeFunctions(const FixedPointTriangleRenderInfo& renderInfo)
+		{
+			const int x[3] = { renderInfo.X1, renderInfo.X2, renderInfo.X3 };
+			const int y[3] = { renderInfo.Y1, renderInfo.Y2, renderInfo.Y3 };
+
+			for (int edge = 0; edge < 3; edge++)
+			{
+				const int next = (edge + 1) % 3;
+				DeltaX[edge] = x[edge] - x[next];
+				DeltaY[edge] = y[edge] - y[next];
+				C[edge] = DeltaY[edge] * x[edge] - DeltaX[edge] * y[edge];
+
+				if (DeltaY[edge] < 0 || (DeltaY[edge] == 0 && DeltaX[edge] > 0)) C[edge]++;
+			}
+		}
+
+		int At(int edge, int x, int y) const
+		{
+			return C[edge] + DeltaX[edge] * (y << 4) - DeltaY[edge] * (x << 4);
+		}
+	};
+
+	// Rasterizes the triangle into a buffer that is pitch pixels wide, where target points at the top left corner of the bounding box of the
+	// triangle. Covered pixels are overwritten and everything else is left alone. This doesn't touch SDL or the device at all, so it can run
+	// on any thread. The shader is a template parameter so that every shading mode gets its own copy of the loop, and the cheap modes don't
+	// pay for what the expensive ones do.
+	template <typename Shader> void RasterizeTriangleInto(const FixedPointTriangleRenderInfo& renderInfo, const Shader& shader, uint32_t* target, std::size_t pitch)
+	{
+		const EdgeFunctions edges(renderInfo);
+
+		const int width = renderInfo.MaxX - renderInfo.MinX;
+		const int height = renderInfo.MaxY - renderInfo.MinY;
+
+		static const CoverageKernel calculateCoverage = SelectCoverageKernel();
+
+		const int32_t fixedDeltaX[3] = { edges.DeltaX[0] << 4, edges.DeltaX[1] << 4, edges.DeltaX[2] << 4 };
+		const int32_t fixedDeltaY[3] = { edges.DeltaY[0] << 4, edges.DeltaY[1] << 4, edges.DeltaY[2] << 4 };
+
+		EdgeLanes lanes;
+		for (int edge = 0; edge < 3; edge++)
+		{
+			for (int i = 0; i < CoverageRowLength; i++) lanes.Offsets[edge][i] = fixedDeltaY[edge] * i;
+		}
+
+		// The bounding box is walked in 8x8 blocks. The edge functions are linear, so checking the corner pixels of a block tells us
+		// whether the whole block is outside one of the edges (skipped), inside all of them (filled without testing), or somewhere in
+		// between, in which case the rows of the block are tested with the coverage kernel. The decisions are made on exactly the same
+		// values the per pixel test would see, so the coverage is identical to testing every pixel.
+		static constexpr int blockSize = CoverageRowLength;
+
+		int32_t blockRowStart[3] = {
+			edges.At(0, renderInfo.MinX, renderInfo.MinY),
+			edges.At(1, renderInfo.MinX, renderInfo.MinY),
+			edges.At(2, renderInfo.MinX, renderInfo.MinY)
+		};
+		for (int blockY = 0; blockY < height; blockY += blockSize)
+		{
+			const int blockHeight = std::min(blockSize, height - blockY);
+
+			int32_t blockStart[3] = { blockRowStart[0], blockRowStart[1], blockRowStart[2] };
+			for (int blockX = 0; blockX < width; blockX += blockSize)
+			{
+				const int blockWidth = std::min(blockSize, width - blockX);
+
+				bool isOutside = false;
+				bool isInside = true;
+				for (int edge = 0; edge < 3; edge++)
+				{
+					const int32_t topLeft = blockStart[edge];
+					const int32_t topRight = topLeft - fixedDeltaY[edge] * (blockWidth - 1);
+					const int32_t bottomLeft = topLeft + fixedDeltaX[edge] * (blockHeight - 1);
+					const int32_t bottomRight = bottomLeft - fixedDeltaY[edge] * (blockWidth - 1);
+
+					const int insideCorners = (topLeft > 0) + (topRight > 0) + (bottomLeft > 0) + (bottomRight > 0);
+					isOutside |= insideCorners == 0;
+					isInside &= insideCorners == 4;
+				}
+
+				if (!isOutside)
+				{
+					int32_t rowStart[3] = { blockStart[0], blockStart[1], blockStart[2] };
+					for (int y = blockY; y < blockY + blockHeight; y++)
+					{
+						uint32_t* row = target + static_cast<std::size_t>(y) * pitch + blockX;
+						const uint32_t coverage = isInside ? (1u << blockWidth) - 1 : calculateCoverage(rowStart, lanes, blockWidth);
+
+						auto cursor = shader.At(blockX, y);
+						for (int i = 0; i < blockWidth; i++, cursor.Step())
+						{
+							if (coverage & (1u << i)) row[i] = cursor.Shade();
+						}
+
+						for (int edge = 0; edge < 3; edge++) rowStart[edge] += fixedDeltaX[edge];
+					}
+				}
+
+				for (int edge = 0; edge < 3; edge++) blockStart[edge] -= fixedDeltaY[edge] * blockSize;
+			}
+
+			for (int edge = 0; edge < 3; edge++) blockRowStart[edge] += fixedDeltaX[edge] * blockSize;
+		}
+	}
+
+	// Rounds towards negative infinity, unlike the division operator. The divisor has to be positive.
+	long long FloorDivide(long long dividend, long long divisor)
+	{
+		return dividend >= 0 ? dividend / divisor : -((-dividend + divisor - 1) / divisor);
+	}
+
+	// Calls the function with every row of the triangle that covers any pixels, along with the first pixel it covers and the one past the
+	// last. Along a row, each edge function is a line in x, so solving it for where it turns positive gives exactly the pixels that
+	// RasterizeTriangleInto would find by testing them.
+	template <typename Function> void ForEachSpan(const FixedPointTriangleRenderInfo& renderInfo, Function&& function)
+	{
+		const EdgeFunctions edges(renderInfo);
+
+		for (int y = renderInfo.MinY; y < renderInfo.MaxY; y++)
+		{
+			int begin = renderInfo.MinX, end = renderInfo.MaxX;
+			for (int edge = 0; edge < 3 && begin < end; edge++)
+			{
+				// The edge function is value - step * x along the row.
+				const long long value = edges.C[edge] + static_cast<long long>(edges.DeltaX[edge]) * y * 16;
+				const long long step = static_cast<long long>(edges.DeltaY[edge]) * 16;
+
+				if (step > 0) end = static_cast<int>(std::min<long long>(end, FloorDivide(value - 1, step) + 1));
+				else if (step < 0) begin = static_cast<int>(std::max<long long>(begin, FloorDivide(-value, -step) + 1));
+				else if (value <= 0) end = begin;
+			}
+
+			if (begin < end) function(y, begin, end);
+		}
+	}
+
+	// Rasterizes the triangle into pixels, which gets resized to the bounding box of the triangle. Returns false if the triangle doesn't
+	// cover any area.
+	template <typename Shader> bool DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const Shader& shader, std::vector<uint32_t>& pixels)
+	{
+		const int width = renderInfo.MaxX - renderInfo.MinX;
+		const int height = renderInfo.MaxY - renderInfo.MinY;
+		if (width == 0 || height == 0) return false;
+
+		IMGUI_SDL_TRACE_ZONE("Rasterize triangle", "pixels", static_cast<long long>(width) * height);
+
+		// The triangle is rasterized into plain memory first and then uploaded with a single call. Drawing the pixels one by one through the
+		// renderer would cost a draw call per pixel, which made cold frames extremely slow.
+		pixels.assign(static_cast<std::size_t>(width) * height, 0);
+		RasterizeTriangleInto(renderInfo, shader, pixels.data(), static_cast<std::size_t>(width));
+		return true;
+	}
+
+	// A vertex attribute interpolated across the triangle. The plane is set up in floating point once per triangle, relative to the top
+	// left corner of the bounding box, and then stepped in 16.16 fixed point from pixel to pixel.
+	struct AttributePlane
+	{
+		float Value = 0.0f, DeltaX = 0.0f, DeltaY = 0.0f;
+
+		AttributePlane() = default;
+
+		AttributePlane(const ImVec2 (&positions)[3], float value0, float value1, float value2)
+		{
+			const float x1 = positions[1].x - positions[0].x, y1 = positions[1].y - positions[0].y;
+			const float x2 = positions[2].x - positions[0].x, y2 = positions[2].y - positions[0].y;
+			const float determinant = x1 * y2 - x2 * y1;
+
+			if (determinant != 0.0f)
+			{
+				DeltaX = ((value1 - value0) * y2 - (value2 - value0) * y1) / determinant;
+				DeltaY = ((value2 - value0) * x1 - (value1 - value0) * x2) / determinant;
+			}
+
+			// We sample at pixel centers.
+			Value = value0 + DeltaX * (0.5f - positions[0].x) + DeltaY * (0.5f - positions[0].y);
+		}
+
+		// Values are 16.16 fixed point in 64 bits. The corners of the pixels are outside of the triangle and the plane keeps going there,
+		// which on slivers and clipped boxes ends up far outside of the range of the attribute, so 32 bits could overflow. The range is
+		// clamped to 2^24 so that the conversion is defined, and stepping across even the widest row stays far from the limits of 64 bits.
+		int64_t FixedAt(int x, int y) const { return ToFixed(Value + DeltaX * x + DeltaY * y); }
+		int64_t FixedStep() const { return ToFixed(DeltaX); }
+
+		static int64_t ToFixed(float value) { return static_cast<int64_t>(std::max(-16777216.0f, std::min(16777216.0f, value)) * 65536.0f); }
+	};
+
+	uint32_t ToChannel(int64_t fixed)
+	{
+		return static_cast<uint32_t>(std::max<int64_t>(0, std::min<int64_t>(255, fixed >> 16)));
+	}
+
+	// Every shader hands out a cursor for the start of a row, which is then stepped one pixel to the right at a time.
+
+	struct FlatShader
+	{
+		uint32_t Color;
+
+		struct Cursor
+		{
+			uint32_t Color;
+
+			uint32_t Shade() const { return Color; }
+			void Step() { }
+		};
+
+		Cursor At(int, int) const { return Cursor{ Color }; }
+	};
+
+	// Interpolates the vertex colors.
+	struct GouraudShader
+	{
+		AttributePlane Channels[4];
+
+		GouraudShader(const ImVec2 (&positions)[3], const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3)
+		{
+			for (int channel = 0; channel < 4; channel++)
+			{
+				const int shift = channel * 8;
+
+				// The extra half makes the truncation to an integer round to the nearest value.
+				Channels[channel] = AttributePlane(positions,
+					((v1.col >> shift) & 0xff) + 0.5f, ((v2.col >> shift) & 0xff) + 0.5f, ((v3.col >> shift) & 0xff) + 0.5f);
+			}
+		}
+
+		struct Cursor
+		{
+			int64_t Values[4], Steps[4];
+
+			uint32_t Shade() const
+			{
+				return ToChannel(Values[0]) | (ToChannel(Values[1]) << 8) | (ToChannel(Values[2]) << 16) | (ToChannel(Values[3]) << 24);
+			}
+
+			void Step()
+			{
+				for (int channel = 0; channel < 4; channel++) Values[channel] += Steps[channel];
+			}
+		};
+
+		Cursor At(int x, int y) const
+		{
+			Cursor cursor;
+			for (int channel = 0; channel < 4; channel++)
+			{
+				cursor.Values[channel] = Channels[channel].FixedAt(x, y);
+				cursor.Steps[channel] = Channels[channel].FixedStep();
+			}
+			return cursor;
+		}
+	};
+
+	// Interpolates the vertex colors and modulates them with a texture. With AlphaOnly set, the texture is known to be white, so only its
+	// alpha channel needs to be read.
+	template <bool AlphaOnly> struct TexturedShader
+	{
+		GouraudShader Shade;
+		AttributePlane U, V;
+		const Texture* Source;
+
+		TexturedShader(const ImVec2 (&positions)[3], const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture)
+			: Shade(positions, v1, v2, v3), Source(texture)
+		{
+			// Texture coordinates are converted into texel positions. The texel is picked the same way the float sampler always did it,
+			// by rounding u * (width - 1) + 0.5, which comes down to truncating u * (width - 1) + 1.
+			const float width = static_cast<float>(texture->Surface->w - 1);
+			const float height = static_cast<float>(texture->Surface->h - 1);
+			U = AttributePlane(positions, v1.uv.x * width + 1.0f, v2.uv.x * width + 1.0f, v3.uv.x * width + 1.0f);
+			V = AttributePlane(positions, v1.uv.y * height + 1.0f, v2.uv.y * height + 1.0f, v3.uv.y * height + 1.0f);
+		}
+
+		struct Cursor
+		{
+			GouraudShader::Cursor Color;
+			int64_t U, V, StepU, StepV;
+			const Texture* Source;
+
+			uint32_t Shade() const
+			{
+				const int x = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(Source->Surface->w - 1, U >> 16)));
+				const int y = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(Source->Surface->h - 1, V >> 16)));
+				const uint32_t shade = Color.Shade();
+
+				if (AlphaOnly)
+				{
+					return (shade & 0x00ffffff) | (Modulate(shade >> 24, Source->AlphaAt(x, y)) << 24);
+				}
+
+				const uint32_t texel = Source->TexelAt(x, y);
+				return Modulate(shade & 0xff, texel & 0xff)
+					| (Modulate((shade >> 8) & 0xff, (texel >> 8) & 0xff) << 8)
+					| (Modulate((shade >> 16) & 0xff, (texel >> 16) & 0xff) << 16)
+					| (Modulate(shade >> 24, texel >> 24) << 24);
+			}
+
+			void Step()
+			{
+				Color.Step();
+				U += StepU;
+				V += StepV;
+			}
+
+			static uint32_t Modulate(uint32_t a, uint32_t b) { return (a * b + 127) / 255; }
+		};
+
+		Cursor At(int x, int y) const
+		{
+			return Cursor{ Shade.At(x, y), U.FixedAt(x, y), V.FixedAt(x, y), U.FixedStep(), V.FixedStep(), Source };
+		}
+	};
+
+	bool RasterizeTriangle(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture, const FixedPointTriangleRenderInfo& renderInfo, std::vector<uint32_t>& pixels)
+	{
+		const ImVec2 origin(static_cast<float>(renderInfo.MinX), static_cast<float>(renderInfo.MinY));
+		const ImVec2 positions[3] = {
+			ImVec2(v1.pos.x - origin.x, v1.pos.y - origin.y),
+			ImVec2(v2.pos.x - origin.x, v2.pos.y - origin.y),
+			ImVec2(v3.pos.x - origin.x, v3.pos.y - origin.y)
+		};
+
+		// Picks the cheapest shader that produces the right result.
+		const ImVec2& white = texture->WhitePixel;
+		const auto isWhite = [&white](const ImDrawVert& v) { return v.uv.x == white.x && v.uv.y == white.y; };
+
+		if (isWhite(v1) && isWhite(v2) && isWhite(v3))
+		{
+			return DrawTriangleWithColorFunction(renderInfo, GouraudShader(positions, v1, v2, v3), pixels);
+		}
+		if (texture->IsAlphaOnly)
+		{
+			return DrawTriangleWithColorFunction(renderInfo, TexturedShader<true>(positions, v1, v2, v3, texture), pixels);
+		}
+		return DrawTriangleWithColorFunction(renderInfo, TexturedShader<false>(positions, v1, v2, v3, texture), pixels);
+	}
+
+	bool RasterizeUniformColorTriangle(uint32_t color, const FixedPointTriangleRenderInfo& renderInfo, std::vector<uint32_t>& pixels)
+	{
+		return DrawTriangleWithColorFunction(renderInfo, FlatShader{ color }, pixels);
+	}
+
+	// Submits the draws that are still waiting in the reorderer and the rectangle batch.
+	void FlushDraws(Device& device)
+	{
+		device.Reorderer.Submit(device.Rectangles);
+		device.Rectangles.Flush();
+	}
+
+	// Uploads a rasterized triangle or polygon into the atlas.
+	template <typename RenderInfo> Device::TriangleCacheItem StoreTriangle(Device& device, const RenderInfo& renderInfo, const uint32_t* pixels)
+	{
+		// Making room may evict an atlas page that draws still waiting for submission copy from, so those have to go first.
+		FlushDraws(device);
+
+		Device::TriangleCacheItem cached;
+		cached.Width = renderInfo.MaxX - renderInfo.MinX;
+		cached.Height = renderInfo.MaxY - renderInfo.MinY;
+		cached.Location = device.Atlas.Store(cached.Width, cached.Height, pixels, device.Frame);
+		return cached;
+	}
+
+	// The naming inconsistency in the parameters is intentional. The fixed point algorithm wants the vertices in a counter clockwise order.
+	FixedPointTriangleRenderInfo CalculateRenderInfo(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3)
+	{
+		return FixedPointTriangleRenderInfo::CalculateFixedPointTriangleInfo(v3.pos, v2.pos, v1.pos);
+	}
+
+	// The triangles of a fan, along with the bounding box of the whole polygon.
+	struct PolygonRenderInfo
+	{
+		std::array<FixedPointTriangleRenderInfo, TriangleFan::MaxTriangles> Triangles;
+		unsigned int TriangleCount;
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	PolygonRenderInfo CalculatePolygonRenderInfo(const TriangleFan& fan)
+	{
+		PolygonRenderInfo renderInfo;
+		renderInfo.TriangleCount = fan.TriangleCount;
+
+		for (unsigned int i = 0; i < fan.TriangleCount; i++)
+		{
+			const auto& triangle = CalculateRenderInfo(fan.Vertex(0), fan.Vertex(i + 1), fan.Vertex(i + 2));
+			renderInfo.Triangles[i] = triangle;
+
+			renderInfo.MinX = i == 0 ? triangle.MinX : std::min(renderInfo.MinX, triangle.MinX);
+			renderInfo.MaxX = i == 0 ? triangle.MaxX : std::max(renderInfo.MaxX, triangle.MaxX);
+			renderInfo.MinY = i == 0 ? triangle.MinY : std::min(renderInfo.MinY, triangle.MinY);
+			renderInfo.MaxY = i == 0 ? triangle.MaxY : std::max(renderInfo.MaxY, triangle.MaxY);
+		}
+
+		return renderInfo;
+	}
+
+	// Every triangle of the fan is rasterized into the same buffer. Neighbouring triangles share their edge exactly, and the top left rule
+	// gives each pixel on it to only one of them, so the polygon comes out without seams and without any pixel being drawn twice.
+	bool RasterizeUniformColorPolygon(uint32_t color, const PolygonRenderInfo& renderInfo, std::vector<uint32_t>& pixels)
+	{
+		const int width = renderInfo.MaxX - renderInfo.MinX;
+		const int height = renderInfo.MaxY - renderInfo.MinY;
+		if (width == 0 || height == 0) return false;
+
+		IMGUI_SDL_TRACE_ZONE("Rasterize polygon", "pixels", static_cast<long long>(width) * height);
+
+		pixels.assign(static_cast<std::size_t>(width) * height, 0);
+
+		const FlatShader shader{ color };
+		for (unsigned int i = 0; i < renderInfo.TriangleCount; i++)
+		{
+			const auto& triangle = renderInfo.Triangles[i];
+			uint32_t* target = pixels.data() + static_cast<std::size_t>(triangle.MinY - renderInfo.MinY) * width + (triangle.MinX - renderInfo.MinX);
+			RasterizeTriangleInto(triangle, shader, target, static_cast<std::size_t>(width));
+		}
+
+		return true;
+	}
+
+	// Positions are stored in the 1/16 of a pixel the rasterizer works in, relative to the top left corner of the bounding box. So the key
+	// holds exactly what gets rasterized: a triangle that moved by whole pixels hits the cache, and one that moved by a fraction of a pixel
+	// doesn't, as it covers other pixel centers and comes out different. The box starts at the first pixel center inside the triangle, so a
+	// vertex can be up to 15/16 of a pixel left of it or above it, which the extra pixel of offset keeps from going negative. 20 bits per
+	// coordinate are enough for triangles up to 65535 pixels across.
+	template <std::size_t WordCount, typename RenderInfo> void PushRelativePosition(KeyPacker<WordCount>& packer, const ImVec2& position, const RenderInfo& renderInfo)
+	{
+		packer.Push(static_cast<uint64_t>(FixedPointTriangleRenderInfo::ToFixedPoint(position.x) - (renderInfo.MinX - 1) * 16), 20);
+		packer.Push(static_cast<uint64_t>(FixedPointTriangleRenderInfo::ToFixedPoint(position.y) - (renderInfo.MinY - 1) * 16), 20);
+	}
+
+	GenericTriangleKey MakeGenericTriangleKey(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const FixedPointTriangleRenderInfo& renderInfo)
+	{
+		GenericTriangleKey key;
+		KeyPacker<7> packer(key);
+
+		for (const ImDrawVert* vertex : { &v1, &v2, &v3 })
+		{
+			// Texture coordinates are kept whole. They pick the texels that are sampled, so any rounding would let triangles that sample
+			// different texels share a key on a big enough atlas. Adding zero turns -0 into 0, which samples the same.
+			PushRelativePosition(packer, vertex->pos, renderInfo);
+			packer.Push(FloatBits(vertex->uv.x + 0.0f), 32);
+			packer.Push(FloatBits(vertex->uv.y + 0.0f), 32);
+			packer.Push(vertex->col, 32);
+		}
+
+		return key;
+	}
+
+	UniformColorTriangleKey MakeUniformColorTriangleKey(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const FixedPointTriangleRenderInfo& renderInfo)
+	{
+		UniformColorTriangleKey key;
+		KeyPacker<3> packer(key);
+
+		packer.Push(v1.col, 32);
+		PushRelativePosition(packer, v1.pos, renderInfo);
+		PushRelativePosition(packer, v2.pos, renderInfo);
+		PushRelativePosition(packer, v3.pos, renderInfo);
+
+		return key;
+	}
+
+	PolygonKey MakeUniformColorPolygonKey(const TriangleFan& fan, const PolygonRenderInfo& renderInfo)
+	{
+		PolygonKey key;
+		KeyPacker<21> packer(key);
+
+		// The vertex count keeps a polygon from matching a smaller one whose unused coordinates would otherwise look like zeros.
+		packer.Push(fan.Vertex(0).col, 32);
+		packer.Push(fan.VertexCount(), 32);
+		for (unsigned int n = 0; n < fan.VertexCount(); n++) PushRelativePosition(packer, fan.Vertex(n).pos, renderInfo);
+
+		return key;
+	}
+
+	// Looks up a triangle from one of the caches. Entries whose atlas page has since been evicted are stale and count as misses. They are
+	// removed on the spot, so that they don't keep taking up the budget of the cache.
+	template <typename Cache, typename Key> Device::TriangleCacheItem* FindCachedTriangle(const TriangleAtlas& atlas, Cache& cache, const Key& key)
+	{
+		Device::TriangleCacheItem* cached = cache.Find(key);
+		if (cached && !atlas.IsValid(cached->Location))
+		{
+			cache.Remove(key);
+			return nullptr;
+		}
+		return cached;
+	}
+
+	// Looks up a triangle for drawing it, and counts the lookup as a hit or a miss.
+	template <typename Cache, typename Key> const Device::TriangleCacheItem* LookUpTriangle(const TriangleAtlas& atlas, Cache& cache, const Key& key, ImGuiSDL::FrameStats::CacheStats& stats)
+	{
+		IMGUI_SDL_TRACE_ZONE("Cache lookup");
+
+		Device::TriangleCacheItem* cached = FindCachedTriangle(atlas, cache, key);
+		if (!cached)
+		{
+			stats.Misses++;
+			return nullptr;
+		}
+
+		if (cached->IsPendingMiss)
+		{
+			cached->IsPendingMiss = false;
+			stats.Misses++;
+		}
+		else
+		{
+			stats.Hits++;
+		}
+		return cached;
+	}
+
+	// Runs a rasterization on the calling thread and adds the time it took to the stats.
+	template <typename Function> bool MeasureRasterization(Device& device, Function&& rasterize)
+	{
+		ScopedTimer timer(device.Stats.RasterizationTime);
+		return rasterize();
+	}
+
+	// Gets the pixels of a triangle that missed the cache, out of the cache file if it's there and from the rasterizer otherwise. Returns null
+	// if the triangle doesn't cover any pixels.
+	template <typename Index, typename Key, typename RenderInfo, typename Function>
+	const uint32_t* LoadOrRasterize(Device& device, const Index& stored, const Key& key, const RenderInfo& renderInfo, Function&& rasterize)
+	{
+		const auto found = stored.find(key);
+		if (found != stored.end() && found->second.Width == renderInfo.MaxX - renderInfo.MinX && found->second.Height == renderInfo.MaxY - renderInfo.MinY)
+		{
+			device.Stats.CacheFileHits++;
+			return found->second.Pixels;
+		}
+
+		if (!MeasureRasterization(device, rasterize)) return nullptr;
+		device.Stats.RasterizedPixels += static_cast<long long>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY);
+		return device.PixelBuffer.data();
+	}
+
+	template <typename RenderInfo> void DrawCachedTriangle(Device& device, const Device::TriangleCacheItem& triangle, const RenderInfo& renderInfo)
+	{
+		device.Atlas.Touch(triangle.Location, device.Frame);
+		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, triangle.Width, triangle.Height };
+
+		// Triangles with a texture of their own aren't held back, since their cache item may get evicted and destroy the texture before
+		// the draw would be submitted.
+		if (device.Configuration.ReorderDraws && triangle.Location.Page >= 0)
+		{
+			device.Reorderer.Add({ DrawReorderer::Draw::DrawKind::AtlasCopy, triangle.Location.Texture, 0, triangle.Location.Source, destination, SDL_FLIP_NONE });
+			return;
+		}
+
+		// The triangle is drawn right away, so everything queued before it has to be drawn first.
+		FlushDraws(device);
+
+		SDL_RenderCopy(device.Renderer, triangle.Location.Texture, &triangle.Location.Source, &destination);
+		device.Stats.SDLCalls++;
+	}
+
+	// Rasterizing is paid for out of the budget of the frame, see ImGuiSDL::Options::RasterizationBudget. Anything may start as long as some
+	// of the budget is left, so a triangle that is bigger than the whole budget still gets its turn at the start of a frame.
+	template <typename RenderInfo> bool TakeRasterizationBudget(Device& device, const RenderInfo& renderInfo)
+	{
+		const long long budget = device.Configuration.RasterizationBudget;
+		if (budget <= 0) return true;
+		if (device.SpentRasterizationBudget >= budget) return false;
+
+		device.SpentRasterizationBudget += static_cast<long long>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY);
+		return true;
+	}
+
+	// Rasterizing a big triangle whole only pays off if it's drawn from the cache again later. One that is mostly outside of the visible
+	// pixels is likely just scrolling past, so only the part of it that shows gets rasterized, and that isn't worth caching.
+	template <typename RenderInfo> bool IsMostlyClipped(const RenderInfo& renderInfo, const SDL_Rect& visible)
+	{
+		static constexpr long long minClippedArea = 128 * 128;
+
+		const long long area = static_cast<long long>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY);
+		if (area < minClippedArea) return false;
+
+		const int visibleWidth = std::min(renderInfo.MaxX, visible.x + visible.w) - std::max(renderInfo.MinX, visible.x);
+		const int visibleHeight = std::min(renderInfo.MaxY, visible.y + visible.h) - std::max(renderInfo.MinY, visible.y);
+		return visibleWidth <= 0 || visibleHeight <= 0 || 4 * static_cast<long long>(visibleWidth) * visibleHeight < area;
+	}
+
+	// Shrinks the bounding box to the visible pixels. The edge functions of the rasterizer are set up from the absolute coordinates of the
+	// vertices, so rasterizing the smaller box gives exactly the pixels of the whole triangle that are inside of it.
+	template <typename RenderInfo> void ClipBoundingBox(RenderInfo& renderInfo, const SDL_Rect& visible)
+	{
+		renderInfo.MinX = std::min(std::max(renderInfo.MinX, visible.x), visible.x + visible.w);
+		renderInfo.MinY = std::min(std::max(renderInfo.MinY, visible.y), visible.y + visible.h);
+		renderInfo.MaxX = std::max(renderInfo.MinX, std::min(renderInfo.MaxX, visible.x + visible.w));
+		renderInfo.MaxY = std::max(renderInfo.MinY, std::min(renderInfo.MaxY, visible.y + visible.h));
+	}
+
+	void ClipRenderInfo(FixedPointTriangleRenderInfo& renderInfo, const SDL_Rect& visible)
+	{
+		ClipBoundingBox(renderInfo, visible);
+	}
+
+	// The triangles of the polygon are clipped to the box of the polygon, so that each of them still lands inside the buffer.
+	void ClipRenderInfo(PolygonRenderInfo& renderInfo, const SDL_Rect& visible)
+	{
+		ClipBoundingBox(renderInfo, visible);
+
+		const SDL_Rect bounds = { renderInfo.MinX, renderInfo.MinY, renderInfo.MaxX - renderInfo.MinX, renderInfo.MaxY - renderInfo.MinY };
+		for (unsigned int i = 0; i < renderInfo.TriangleCount; i++) ClipBoundingBox(renderInfo.Triangles[i], bounds);
+	}
+
+	// Rasterizes just the visible part of a triangle or polygon and draws it without caching it. All of them go through the same texture,
+	// which SDL takes care of by drawing whatever still uses the texture before it's updated. Returns false if the rasterization budget of
+	// the frame is used up, in which case nothing is drawn.
+	template <typename RenderInfo, typename Function> bool DrawVisiblePart(Device& device, RenderInfo renderInfo, const SDL_Rect& visible, Function&& rasterize)
+	{
+		ClipRenderInfo(renderInfo, visible);
+		if (!TakeRasterizationBudget(device, renderInfo)) return false;
+
+		device.Stats.ClippedTriangles++;
+		if (!MeasureRasterization(device, [&] { return rasterize(renderInfo); })) return true;
+
+		const int width = renderInfo.MaxX - renderInfo.MinX;
+		const int height = renderInfo.MaxY - renderInfo.MinY;
+		device.Stats.RasterizedPixels += static_cast<long long>(width) * height;
+
+		// If the bigger texture can't be made, the smaller one is kept for the triangles that still fit into it, and this one isn't drawn.
+		if (width > device.ClippedTextureWidth || height > device.ClippedTextureHeight)
+		{
+			const int textureWidth = std::max(width, device.ClippedTextureWidth);
+			const int textureHeight = std::max(height, device.ClippedTextureHeight);
+
+			OwnedTexture texture;
+			texture.Texture = device.Atlas.MakeTexture(textureWidth, textureHeight);
+			if (!texture.Texture) return true;
+
+			device.ClippedTexture = std::move(texture);
+			device.ClippedTextureWidth = textureWidth;
+			device.ClippedTextureHeight = textureHeight;
+		}
+
+		// Everything queued before the triangle has to be drawn first, as it's drawn right away.
+		FlushDraws(device);
+
+		const SDL_Rect source = { 0, 0, width, height };
+		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, width, height };
+		{
+			ScopedTimer timer(device.Stats.UploadTime);
+			IMGUI_SDL_TRACE_ZONE("Upload clipped triangle", "pixels", static_cast<long long>(width) * height);
+			SDL_UpdateTexture(device.ClippedTexture.Texture, &source, device.PixelBuffer.data(), width * static_cast<int>(sizeof(uint32_t)));
+		}
+		SDL_RenderCopy(device.Renderer, device.ClippedTexture.Texture, &source, &destination);
+		device.Stats.SDLCalls += 2;
+		return true;
+	}
+
+	bool IsSpanTriangle(const Device& device, const FixedPointTriangleRenderInfo& renderInfo)
+	{
+		return static_cast<long long>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY) >= device.Configuration.SpanFillArea;
+	}
+
+	// Fills the pixels of a triangle row by row with rectangles. Rows that cover the same pixels as the one above them are merged into one
+	// rectangle.
+	void FillSpans(Device& device, uint32_t color, const FixedPointTriangleRenderInfo& renderInfo)
+	{
+		const auto fill = [&device, color](const SDL_Rect& destination) {
+			if (device.Configuration.ReorderDraws) device.Reorderer.Add({ DrawReorderer::Draw::DrawKind::Fill, nullptr, color, {}, destination, SDL_FLIP_NONE });
+			else device.Rectangles.AddFill(destination, color);
+		};
+
+		SDL_Rect pending = { 0, 0, 0, 0 };
+		ForEachSpan(renderInfo, [&](int y, int begin, int end) {
+			if (pending.h > 0 && pending.y + pending.h == y && pending.x == begin && pending.x + pending.w == end)
+			{
+				pending.h++;
+				return;
+			}
+
+			if (pending.h > 0) fill(pending);
+			pending = { begin, y, end - begin, 1 };
+		});
+		if (pending.h > 0) fill(pending);
+	}
+
+	// Fills a big triangle row by row, without a texture or a cache entry. See ImGuiSDL::Options::SpanFillArea. Rows outside of the visible
+	// pixels aren't filled at all.
+	void DrawSpanTriangle(Device& device, uint32_t color, FixedPointTriangleRenderInfo renderInfo, const SDL_Rect& visible)
+	{
+		IMGUI_SDL_TRACE_ZONE("Fill spans", "pixels", static_cast<long long>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY));
+		device.Stats.SpanTriangles++;
+		ClipRenderInfo(renderInfo, visible);
+		FillSpans(device, color, renderInfo);
+	}
+
+	uint32_t AverageColor(uint32_t c1, uint32_t c2, uint32_t c3)
+	{
+		uint32_t average = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			const uint32_t sum = ((c1 >> shift) & 0xff) + ((c2 >> shift) & 0xff) + ((c3 >> shift) & 0xff);
+			average |= (sum / 3) << shift;
+		}
+		return average;
+	}
+
+	// What a triangle that is over the rasterization budget is drawn as until it gets its turn: its exact shape filled with the average color
+	// of its vertices, which takes neither rasterizing nor a texture. Uniform color triangles come out just like they should, and the rest
+	// only lose their gradient and texture for a frame or two. See ImGuiSDL::Options::RasterizationBudget.
+	void DrawStandIn(Device& device, uint32_t color, FixedPointTriangleRenderInfo renderInfo, const SDL_Rect& visible)
+	{
+		device.Stats.StandIns++;
+		ClipRenderInfo(renderInfo, visible);
+		FillSpans(device, color, renderInfo);
+	}
+
+	void DrawStandIn(Device& device, const TriangleFan& fan, const PolygonRenderInfo& renderInfo, const SDL_Rect& visible)
+	{
+		device.Stats.StandIns++;
+		for (unsigned int i = 0; i < renderInfo.TriangleCount; i++)
+		{
+			FixedPointTriangleRenderInfo triangle = renderInfo.Triangles[i];
+			ClipRenderInfo(triangle, visible);
+			FillSpans(device, fan.Vertex(0).col, triangle);
+		}
+	}
+
+	void DrawTriangle(Device& device, const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture, const SDL_Rect& visible)
+	{
+		const auto& renderInfo = CalculateRenderInfo(v1, v2, v3);
+
+		// First we check if there is a cached version of this triangle already waiting for us. If so, we can just do a super fast texture copy.
+		device.Stats.GenericTriangles++;
+
+		const auto key = MakeGenericTriangleKey(v1, v2, v3, renderInfo);
+		if (const auto* cached = LookUpTriangle(device.Atlas, device.GenericTriangleCache, key, device.Stats.GenericTriangleCache))
+		{
+			DrawCachedTriangle(device, *cached, renderInfo);
+			return;
+		}
+
+		const bool isStored = device.CacheFile.Triangles.count(key) != 0;
+		if (IsMostlyClipped(renderInfo, visible) && !isStored)
+		{
+			if (!DrawVisiblePart(device, renderInfo, visible,
+				[&](const FixedPointTriangleRenderInfo& clipped) { return RasterizeTriangle(v1, v2, v3, texture, clipped, device.PixelBuffer); }))
+			{
+				DrawStandIn(device, AverageColor(v1.col, v2.col, v3.col), renderInfo, visible);
+			}
+			return;
+		}
+
+		if (!isStored && !TakeRasterizationBudget(device, renderInfo))
+		{
+			DrawStandIn(device, AverageColor(v1.col, v2.col, v3.col), renderInfo, visible);
+			return;
+		}
+
+		const uint32_t* pixels = LoadOrRasterize(device, device.CacheFile.Triangles, key, renderInfo,
+			[&] { return RasterizeTriangle(v1, v2, v3, texture, renderInfo, device.PixelBuffer); });
+		if (!pixels) return;
+
+		auto cached = StoreTriangle(device, renderInfo, pixels);
+		DrawCachedTriangle(device, cached, renderInfo);
+
+		const std::size_t bytes = cached.Bytes();
+		device.GenericTriangleCache.Insert(key, std::move(cached), bytes);
+	}
+
+	void DrawUniformColorTriangle(Device& device, const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const SDL_Rect& visible)
+	{
+		const auto& renderInfo = CalculateRenderInfo(v1, v2, v3);
+
+		if (IsSpanTriangle(device, renderInfo))
+		{
+			DrawSpanTriangle(device, v1.col, renderInfo, visible);
+			return;
+		}
+
+		device.Stats.UniformColorTriangles++;
+
+		const auto key = MakeUniformColorTriangleKey(v1, v2, v3, renderInfo);
+		if (const auto* cached = LookUpTriangle(device.Atlas, device.UniformColorTriangleCache, key, device.Stats.UniformColorTriangleCache))
+		{
+			DrawCachedTriangle(device, *cached, renderInfo);
+			return;
+		}
+
+		const bool isStored = device.CacheFile.UniformColorTriangles.count(key) != 0;
+		if (IsMostlyClipped(renderInfo, visible) && !isStored)
+		{
+			if (!DrawVisiblePart(device, renderInfo, visible,
+				[&](const FixedPointTriangleRenderInfo& clipped) { return RasterizeUniformColorTriangle(v1.col, clipped, device.PixelBuffer); }))
+			{
+				DrawStandIn(device, v1.col, renderInfo, visible);
+			}
+			return;
+		}
+
+		if (!isStored && !TakeRasterizationBudget(device, renderInfo))
+		{
+			DrawStandIn(device, v1.col, renderInfo, visible);
+			return;
+		}
+
+		const uint32_t* pixels = LoadOrRasterize(device, device.CacheFile.UniformColorTriangles, key, renderInfo,
+			[&] { return RasterizeUniformColorTriangle(v1.col, renderInfo, device.PixelBuffer); });
+		if (!pixels) return;
+
+		auto cached = StoreTriangle(device, renderInfo, pixels);
+		DrawCachedTriangle(device, cached, renderInfo);
+
+		const std::size_t bytes = cached.Bytes();
+		device.UniformColorTriangleCache.Insert(key, std::move(cached), bytes);
+	}
+
+	// The whole polygon is cached and drawn as one piece, instead of a copy for each of its triangles.
+	void DrawUniformColorPolygon(Device& device, const TriangleFan& fan, const SDL_Rect& visible)
+	{
+		const auto& renderInfo = CalculatePolygonRenderInfo(fan);
+
+		device.Stats.Polygons++;
+
+		const auto key = MakeUniformColorPolygonKey(fan, renderInfo);
+		if (const auto* cached = LookUpTriangle(device.Atlas, device.PolygonCache, key, device.Stats.PolygonCache))
+		{
+			DrawCachedTriangle(device, *cached, renderInfo);
+			return;
+		}
+
+		const bool isStored = device.CacheFile.Polygons.count(key) != 0;
+		if (IsMostlyClipped(renderInfo, visible) && !isStored)
+		{
+			if (!DrawVisiblePart(device, renderInfo, visible,
+				[&](const PolygonRenderInfo& clipped) { return RasterizeUniformColorPolygon(fan.Vertex(0).col, clipped, device.PixelBuffer); }))
+			{
+				DrawStandIn(device, fan, renderInfo, visible);
+			}
+			return;
+		}
+
+		if (!isStored && !TakeRasterizationBudget(device, renderInfo))
+		{
+			DrawStandIn(device, fan, renderInfo, visible);
+			return;
+		}
+
+		const uint32_t* pixels = LoadOrRasterize(device, device.CacheFile.Polygons, key, renderInfo,
+			[&] { return RasterizeUniformColorPolygon(fan.Vertex(0).col, renderInfo, device.PixelBuffer); });
+		if (!pixels) return;
+
+		auto cached = StoreTriangle(device, renderInfo, pixels);
+		DrawCachedTriangle(device, cached, renderInfo);
+
+		const std::size_t bytes = cached.Bytes();
+		device.PolygonCache.Insert(key, std::move(cached), bytes);
+	}
+
+	void DrawRectangle(Device& device, const Rect& bounding, SDL_Texture* texture, int textureWidth, int textureHeight, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
+	{
+		// We are safe to assume uniform color here, because the caller checks it and and uses the triangle renderer to render those.
+
+		const SDL_Rect destination = bounding.Destination();
+
+		// If the area isn't textured, we can just draw a rectangle with the correct color.
+		if (bounding.UsesOnlyColor(device.FontTexture.WhitePixel))
+		{
+			if (device.Configuration.ReorderDraws) device.Reorderer.Add({ DrawReorderer::Draw::DrawKind::Fill, nullptr, color, {}, destination, SDL_FLIP_NONE });
+			else device.Rectangles.AddFill(destination, color);
+		}
+		else
+		{
+			// We can now just calculate the correct source rectangle and draw it.
+			const SDL_Rect source = bounding.Source(textureWidth, textureHeight);
+			const SDL_RendererFlip flip = Rect::Flip(doHorizontalFlip, doVerticalFlip);
+
+			if (device.Configuration.ReorderDraws) device.Reorderer.Add({ DrawReorderer::Draw::DrawKind::Copy, texture, color, source, destination, flip });
+			else device.Rectangles.AddCopy(texture, source, destination, flip, color);
+		}
+	}
+
+	void DrawRectangle(Device& device, const Rect& bounding, const Texture* texture, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
+	{
+		DrawRectangle(device, bounding, texture->Source, texture->Surface->w, texture->Surface->h, color, doHorizontalFlip, doVerticalFlip);
+	}
+
+	void DrawRectangle(Device& device, const Rect& bounding, SDL_Texture* texture, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
+	{
+		int width, height;
+		SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+		DrawRectangle(device, bounding, texture, width, height, color, doHorizontalFlip, doVerticalFlip);
+	}
+
+	// Gradients are stretched from a texture with linear filtering, which SDL only does for textures that ask for it. SDL_SetTextureScaleMode
+	// only exists since SDL 2.0.12, and before that the filtering was picked from a hint when the texture was created.
+	SDL_Texture* MakeGradientTexture(Device& device, const GradientCorners& corners)
+	{
+		IMGUI_SDL_TRACE_ZONE("Create gradient texture");
+
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+		SDL_Texture* texture = CreateTexture(device.Renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, 2, 2);
+		if (texture) SDL_SetTextureScaleMode(texture, SDL_ScaleModeLinear);
+#else
+		const char* quality = SDL_GetHint(SDL_HINT_RENDER_SCALE_QUALITY);
+		const std::string previousQuality = quality ? quality : "";
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+		SDL_Texture* texture = CreateTexture(device.Renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, 2, 2);
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, quality ? previousQuality.c_str() : nullptr);
+#endif
+		if (!texture) return nullptr;
+
+		SDL_UpdateTexture(texture, nullptr, corners.data(), 2 * sizeof(uint32_t));
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		device.Stats.SDLCalls += 3;
+		return texture;
+	}
+
+	// Linear filtering blends between the centers of the texels, so the 2x2 texture is drawn twice as big as the rectangle, which puts the
+	// texel centers right on its corners, and the clip rect cuts it down to the rectangle itself. Returns false if the texture couldn't be
+	// made, and then the rectangle is drawn as the two triangles it is after all.
+	bool DrawGradientRectangle(Device& device, const Rect& bounding, const GradientCorners& corners, const SDL_Rect& clipRect)
+	{
+		Device::GradientKey key;
+		KeyPacker<2> packer(key);
+		for (const uint32_t color : corners) packer.Push(color, 32);
+
+		SDL_Texture* texture;
+		if (const auto* cached = device.GradientCache.Find(key))
+		{
+			texture = cached->Texture;
+		}
+		else
+		{
+			ScopedTimer timer(device.Stats.UploadTime);
+
+			OwnedTexture gradient;
+			gradient.Texture = MakeGradientTexture(device, corners);
+			if (!gradient.Texture) return false;
+
+			texture = gradient.Texture;
+			device.GradientCache.Insert(key, std::move(gradient), 1);
+		}
+
+		device.Stats.GradientRectangles++;
+
+		const SDL_Rect rectangle = bounding.Destination();
+		SDL_Rect area = rectangle;
+		if (clipRect.w > 0 && clipRect.h > 0 && !SDL_IntersectRect(&rectangle, &clipRect, &area)) return true;
+
+		// The clip rect changes under whatever is still waiting to be drawn, so that has to go first.
+		FlushDraws(device);
+		device.State.SetClipRect(&area);
+
+		const SDL_Rect source = { 0, 0, 2, 2 };
+		// Odd sizes can't be doubled around the center in whole pixels, so they get half a pixel more on both sides instead of a whole one on
+		// just the one side, which keeps the texel centers the same distance off the corners all around.
+		const int marginX = (rectangle.w + 1) / 2, marginY = (rectangle.h + 1) / 2;
+		const SDL_Rect destination = { rectangle.x - marginX, rectangle.y - marginY, rectangle.w + 2 * marginX, rectangle.h + 2 * marginY };
+		SDL_RenderCopy(device.Renderer, texture, &source, &destination);
+		device.Stats.SDLCalls++;
+
+		device.State.SetClipRect(&clipRect);
+		return true;
+	}
+
+	// Checks whether the six vertices are two triangles that together cover their bounding box with nothing but the white pixel, and finds
+	// out the colors of the corners if they are. Stretching the gradient texture blends the four corners bilinearly, while the two triangles
+	// each blend their own three corners, and the two only look the same when opposite corners add up to the same color. Luckily that's
+	// true for everything ImGui draws with AddRectFilledMultiColor, like the color picker, since its gradients go from one side to the other.
+	bool FindGradientCorners(const Rect& bounding, const ImDrawVert* const (&vertices)[6], const ImVec2& whitePixel, GradientCorners& corners)
+	{
+		if (bounding.MinX == bounding.MaxX || bounding.MinY == bounding.MaxY) return false;
+
+		int seenCorners = 0;
+		int triangleCorners[2] = { 0, 0 };
+		for (int v = 0; v < 6; v++)
+		{
+			const ImDrawVert& vertex = *vertices[v];
+			if (!bounding.IsOnExtreme(vertex.pos) || vertex.uv.x != whitePixel.x || vertex.uv.y != whitePixel.y) return false;
+
+			const int corner = (vertex.pos.x == bounding.MaxX ? 1 : 0) | (vertex.pos.y == bounding.MaxY ? 2 : 0);
+			if (seenCorners & (1 << corner))
+			{
+				if (corners[corner] != vertex.col) return false;
+			}
+			else
+			{
+				corners[corner] = vertex.col;
+				seenCorners |= 1 << corner;
+			}
+			triangleCorners[v / 3] |= 1 << corner;
+		}
+
+		// Each triangle has to leave out a single corner, and those have to be opposite each other, or the triangles wouldn't meet along
+		// a diagonal and cover the whole rectangle.
+		const int leftOut[2] = { triangleCorners[0] ^ 0xf, triangleCorners[1] ^ 0xf };
+		const int diagonal = leftOut[0] | leftOut[1];
+		if ((diagonal != 0x9 && diagonal != 0x6) || leftOut[0] == diagonal || leftOut[1] == diagonal) return false;
+
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			const auto channel = [&](int corner) { return static_cast<int>((corners[corner] >> shift) & 0xff); };
+			if (channel(0) + channel(3) != channel(1) + channel(2)) return false;
+		}
+		return true;
+	}
+
+	// Sorts the triangles of a draw command into rectangles, gradient rectangles, uniform color polygons, uniform color triangles and generic
+	// triangles, and adds them to the stream. The first index is where the indices of the command start in the index buffer of its list.
+	void ClassifyTriangles(const ImDrawVert* vertexBuffer, const ImDrawIdx* indexBuffer, uint32_t firstIndex, unsigned int elementCount, const ImVec2& whitePixel,
+		PrimitiveStream& stream)
+	{
+		// Loops over triangles.
+		for (unsigned int i = 0; i + 3 <= elementCount; i += 3)
+		{
+			const ImDrawVert& v0 = vertexBuffer[indexBuffer[i + 0]];
+			const ImDrawVert& v1 = vertexBuffer[indexBuffer[i + 1]];
+			const ImDrawVert& v2 = vertexBuffer[indexBuffer[i + 2]];
+
+			const Rect& bounding = Rect::CalculateBoundingBox(v0, v1, v2);
+
+			const bool isTriangleUniformColor = v0.col == v1.col && v1.col == v2.col;
+			const bool doesTriangleUseOnlyColor = bounding.UsesOnlyColor(whitePixel);
+
+			// Actually, since we render a whole bunch of rectangles, we try to first detect those, and render them more efficiently.
+			// How are rectangles detected? It's actually pretty simple: If all 6 vertices lie on the extremes of the bounding box,
+			// it's a rectangle.
+			if (i + 6 <= elementCount)
+			{
+				const ImDrawVert& v3 = vertexBuffer[indexBuffer[i + 3]];
+				const ImDrawVert& v4 = vertexBuffer[indexBuffer[i + 4]];
+				const ImDrawVert& v5 = vertexBuffer[indexBuffer[i + 5]];
+
+				const bool isUniformColor = isTriangleUniformColor && v2.col == v3.col && v3.col == v4.col && v4.col == v5.col;
+
+				if (isUniformColor
+				&& bounding.IsOnExtreme(v0.pos)
+				&& bounding.IsOnExtreme(v1.pos)
+				&& bounding.IsOnExtreme(v2.pos)
+				&& bounding.IsOnExtreme(v3.pos)
+				&& bounding.IsOnExtreme(v4.pos)
+				&& bounding.IsOnExtreme(v5.pos))
+				{
+					// Both triangles of a rectangle span the whole of it, so the box of the first one is the box of the rectangle.
+					stream.Add(PrimitiveKind::Rectangle, firstIndex + i, 2, bounding);
+
+					i += 3;  // Additional increment to account for the extra 3 vertices we consumed.
+					continue;
+				}
+
+				// Rectangles with colors that change across them, like the color picker, would otherwise become two big generic triangles
+				// that miss the cache every time the rectangle changes its size.
+				GradientCorners corners;
+				const ImDrawVert* const quad[6] = { &v0, &v1, &v2, &v3, &v4, &v5 };
+				if (!isUniformColor && doesTriangleUseOnlyColor && FindGradientCorners(bounding, quad, whitePixel, corners))
+				{
+					stream.Add(PrimitiveKind::GradientRectangle, firstIndex + i, 2, bounding);
+					stream.Gradients.push_back(corners);
+
+					i += 3;
+					continue;
+				}
+			}
+
+			if (isTriangleUniformColor && doesTriangleUseOnlyColor)
+			{
+				// Circles and other filled shapes are fans of thin triangles, and caching those one by one means a lookup and a copy for
+				// every sliver. So we check whether the following triangles continue a fan from this one with the same color, and if
+				// they do, the whole polygon is handed over as one.
+				TriangleFan fan = { vertexBuffer, indexBuffer + i, 1 };
+				while (fan.TriangleCount < TriangleFan::MaxTriangles && i + 3 * (fan.TriangleCount + 1) <= elementCount)
+				{
+					const ImDrawIdx* next = fan.Indices + 3 * fan.TriangleCount;
+					const ImDrawVert& vertex = vertexBuffer[next[2]];
+
+					if (next[0] != fan.Indices[0] || next[1] != next[-1]) break;
+					if (vertex.col != v0.col || vertex.uv.x != whitePixel.x || vertex.uv.y != whitePixel.y) break;
+
+					fan.TriangleCount++;
+				}
+
+				if (fan.TriangleCount > 1)
+				{
+					Rect polygonBounding = bounding;
+					for (unsigned int n = 3; n < fan.VertexCount(); n++)
+					{
+						const ImVec2& position = fan.Vertex(n).pos;
+						polygonBounding.MinX = std::min(polygonBounding.MinX, position.x);
+						polygonBounding.MinY = std::min(polygonBounding.MinY, position.y);
+						polygonBounding.MaxX = std::max(polygonBounding.MaxX, position.x);
+						polygonBounding.MaxY = std::max(polygonBounding.MaxY, position.y);
+					}
+					stream.Add(PrimitiveKind::Polygon, firstIndex + i, fan.TriangleCount, polygonBounding);
+
+					i += 3 * (fan.TriangleCount - 1);  // Skips the rest of the triangles of the fan.
+					continue;
+				}
+
+				stream.Add(PrimitiveKind::UniformColorTriangle, firstIndex + i, 1, bounding);
+			}
+			else
+			{
+				stream.Add(PrimitiveKind::Triangle, firstIndex + i, 1, bounding);
+			}
+		}
+	}
+
+	// The front end of the rasterizer path. It walks the triangles of a draw list once and sorts them into the primitives of the stream, with
+	// nothing but the vertices and the white pixel of the font to go on. Both the rendering and the cache miss prepass draw from the same
+	// stream, so they always agree on how each triangle is going to be drawn. Nothing is culled here, since what is visible depends on
+	// where the list ends up being drawn.
+	void BuildPrimitiveStream(const ImDrawList* commandList, const ImVec2& whitePixel, PrimitiveStream& stream)
+	{
+		stream.Clear();
+
+		uint32_t firstIndex = 0;
+		for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
+		{
+			const ImDrawCmd* drawCommand = &commandList->CmdBuffer[cmd_i];
+			PrimitiveStream::CommandRange range = { stream.Count(), stream.Count(), static_cast<uint32_t>(stream.Gradients.size()) };
+
+			if (!drawCommand->UserCallback)
+			{
+				ClassifyTriangles(commandList->VtxBuffer.Data, commandList->IdxBuffer.Data + firstIndex, firstIndex, drawCommand->ElemCount, whitePixel, stream);
+			}
+
+			range.End = stream.Count();
+			stream.Commands.push_back(range);
+			firstIndex += drawCommand->ElemCount;
+		}
+
+		stream.IsClassified = true;
+	}
+
+	// Builds the stream of the list unless it already was built for this frame.
+	void ClassifyDrawList(Device& device, const ImDrawList* commandList, PrimitiveStream& stream)
+	{
+		if (stream.IsClassified) return;
+
+		IMGUI_SDL_TRACE_ZONE("Classify draw list", "elements", commandList->IdxBuffer.Size);
+		ScopedTimer timer(device.Stats.ClassificationTime);
+		BuildPrimitiveStream(commandList, device.FontTexture.WhitePixel, stream);
+	}
+
+	// The streams that are left over from the last frame belong to other lists, or to these lists before they changed.
+	void ResetPrimitiveStreams(Device& device, int listCount)
+	{
+		device.PrimitiveStreams.resize(listCount);
+		for (PrimitiveStream& stream : device.PrimitiveStreams) stream.IsClassified = false;
+	}
+
+	// Hands the primitives of a draw command to the function for their kind, with the given vertices, which are either the ones the stream
+	// was built from or a copy of them moved by the offset. The gradient rectangle function returns whether it drew the rectangle, and if it
+	// didn't, its triangles are drawn as generic triangles.
+	// Anything whose bounding box misses the visible pixels is dropped here instead of being handed to one of the functions. Shapes are
+	// sorted out before they are culled, so that a polygon that is partly visible is still handed over whole and keeps hitting the cache as
+	// it scrolls. Returns the number of triangles that were culled.
+	template <typename RectangleFunction, typename GradientRectangleFunction, typename PolygonFunction, typename UniformColorTriangleFunction, typename TriangleFunction>
+	unsigned int DrawPrimitives(const PrimitiveStream& stream, int commandIndex, const ImDrawVert* vertexBuffer, const ImDrawIdx* indexBuffer, int offsetX, int offsetY,
+		const SDL_Rect& visible, RectangleFunction&& onRectangle, GradientRectangleFunction&& onGradientRectangle, PolygonFunction&& onPolygon,
+		UniformColorTriangleFunction&& onUniformColorTriangle, TriangleFunction&& onTriangle)
+	{
+		const PrimitiveStream::CommandRange& range = stream.Commands[commandIndex];
+		const float moveX = static_cast<float>(offsetX), moveY = static_cast<float>(offsetY);
+
+		unsigned int culledTriangles = 0;
+		uint32_t gradient = range.FirstGradient;
+
+		for (uint32_t p = range.Begin; p < range.End; p++)
+		{
+			const PrimitiveKind kind = stream.Kinds[p];
+			const ImDrawIdx* indices = indexBuffer + stream.FirstIndices[p];
+			const GradientCorners* corners = kind == PrimitiveKind::GradientRectangle ? &stream.Gradients[gradient++] : nullptr;
+
+			Rect bounding = stream.Bounds[p];
+			bounding.MinX -= moveX;
+			bounding.MaxX -= moveX;
+			bounding.MinY -= moveY;
+			bounding.MaxY -= moveY;
+
+			if (!bounding.Intersects(visible))
+			{
+				culledTriangles += stream.TriangleCounts[p];
+				continue;
+			}
+
+			const ImDrawVert& v0 = vertexBuffer[indices[0]];
+			const ImDrawVert& v1 = vertexBuffer[indices[1]];
+			const ImDrawVert& v2 = vertexBuffer[indices[2]];
+
+			switch (kind)
+			{
+			case PrimitiveKind::Rectangle:
+				// ImGui gives the triangles in a nice order: the first vertex happens to be the topleft corner of our rectangle.
+				// We need to check for the orientation of the texture, as I believe in theory ImGui could feed us a flipped texture,
+				// so that the larger texture coordinates are at topleft instead of bottomright.
+				// We don't consider equal texture coordinates to require a flip, as then the rectangle is mostlikely simply a colored rectangle.
+				onRectangle(bounding, v0.col, v2.uv.x < v0.uv.x, v2.uv.x < v0.uv.x);
+				break;
+			case PrimitiveKind::GradientRectangle:
+				if (!onGradientRectangle(bounding, *corners))
+				{
+					onTriangle(v0, v1, v2);
+					onTriangle(vertexBuffer[indices[3]], vertexBuffer[indices[4]], vertexBuffer[indices[5]]);
+				}
+				break;
+			case PrimitiveKind::Polygon:
+				onPolygon(TriangleFan{ vertexBuffer, indices, stream.TriangleCounts[p] });
+				break;
+			case PrimitiveKind::UniformColorTriangle:
+				onUniformColorTriangle(v0, v1, v2);
+				break;
+			case PrimitiveKind::Triangle:
+				onTriangle(v0, v1, v2);
+				break;
+			}
+		}
+
+		return culledTriangles;
+	}
+
+	// The clip rect of a draw command, moved by the offset its vertices are drawn with. The rect is rounded before it's moved, so that moving
+	// it by whole pixels doesn't change which pixels it covers.
+	SDL_Rect CalculateClipRect(const ImDrawCmd& drawCommand, int offsetX, int offsetY)
+	{
+		const SDL_Rect clipRect = {
+			static_cast<int>(drawCommand.ClipRect.x) - offsetX,
+			static_cast<int>(drawCommand.ClipRect.y) - offsetY,
+			static_cast<int>(drawCommand.ClipRect.z - drawCommand.ClipRect.x),
+			static_cast<int>(drawCommand.ClipRect.w - drawCommand.ClipRect.y)
+		};
+		return clipRect;
+	}
+
+	// The pixels that the draws of a command can show up in, which is its clip rect within the target. An empty clip rect means no clipping,
+	// like it does for SDL_RenderSetClipRect. Returns false if nothing of the target is visible, in which case the command can be skipped.
+	bool CalculateVisibleRect(const SDL_Rect& clipRect, const SDL_Rect& target, SDL_Rect& visible)
+	{
+		if (clipRect.w > 0 && clipRect.h > 0) return SDL_IntersectRect(&clipRect, &target, &visible) == SDL_TRUE;
+
+		visible = target;
+		return target.w > 0 && target.h > 0;
+	}
+
+	// The prepass isn't allowed to ask the renderer how big the target is, so it only culls by the clip rects.
+	const SDL_Rect UnboundedTarget = { -(1 << 24), -(1 << 24), 1 << 25, 1 << 25 };
+
+	// Draws are positioned relative to the viewport of the renderer, which is also all of the target they can reach. The viewport is the
+	// whole of the render target, unless the application has set it to something else.
+	SDL_Rect CalculateRenderTarget(Device& device)
+	{
+		SDL_Rect viewport;
+		SDL_RenderGetViewport(device.Renderer, &viewport);
+
+		const SDL_Rect target = { 0, 0, viewport.w, viewport.h };
+		return target;
+	}
+
+	// Nothing a list draws can end up outside of the clip rects of its commands, so their union is all the texture of the list needs to hold.
+	// Lists with user callbacks or textures of the application aren't retained, because those can draw something different without the
+	// list changing. Neither are the ones with an empty clip rect, which SDL takes to mean no clipping at all.
+	bool CalculateRetainedBounds(const Device& device, const ImDrawList* commandList, SDL_Rect& bounds)
+	{
+		bool isEmpty = true;
+		for (const ImDrawCmd& drawCommand : commandList->CmdBuffer)
+		{
+			if (drawCommand.UserCallback || !device.IsFontTexture(drawCommand.TextureId)) return false;
+			if (drawCommand.ElemCount == 0) continue;
+
+			const SDL_Rect clipRect = CalculateClipRect(drawCommand, 0, 0);
+			if (clipRect.w <= 0 || clipRect.h <= 0) return false;
+
+			if (isEmpty) bounds = clipRect;
+			else SDL_UnionRect(&bounds, &clipRect, &bounds);
+			isEmpty = false;
+		}
+
+		return !isEmpty && bounds.w <= device.MaxRetainedTextureWidth && bounds.h <= device.MaxRetainedTextureHeight;
+	}
+
+	// Decides for every list of the frame whether it's drawn straight to the screen, drawn into its retained texture, or only copied from the
+	// texture because it's the same as last time. A list that has only moved by whole pixels hashes the same, since the hash is taken
+	// relative to its bounds. This doesn't make any SDL calls, so it's part of what Prepare can do on any thread.
+	void PlanDrawLists(Device& device, const ImDrawData* drawData)
+	{
+		device.DrawListPlans.assign(drawData->CmdListsCount, DrawListPlan());
+		ResetPrimitiveStreams(device, drawData->CmdListsCount);
+		if (!device.Configuration.RetainDrawLists || !device.CanRetainDrawLists) return;
+
+		for (int n = 0; n < drawData->CmdListsCount; n++)
+		{
+			const ImDrawList* commandList = drawData->CmdLists[n];
+			DrawListPlan& plan = device.DrawListPlans[n];
+			if (!CalculateRetainedBounds(device, commandList, plan.Bounds)) continue;
+
+			plan.Retained = &device.RetainedDrawLists[commandList];
+			plan.Hash = HashDrawList(commandList, plan.Bounds);
+			plan.IsUnchanged = plan.Retained->IsValid && plan.Retained->Hash == plan.Hash;
+		}
+	}
+
+	// Queuing more misses than a cache can hold would just make them evict each other before they get drawn, so a miss is only queued while
+	// the ones queued before it still fit into the budget of the cache. Whatever doesn't get queued is rasterized during drawing like before.
+	// Misses that are in the cache file aren't queued either, as drawing loads them from there, and neither are the ones over the rasterization
+	// budget of the frame, which drawing puts stand-ins in for.
+	template <typename Cache, typename Index, typename Set, typename Key, typename RenderInfo>
+	bool ShouldQueue(Device& device, Cache& cache, const Index& stored, Set& queued, std::size_t& queuedBytes, const Key& key, const RenderInfo& renderInfo)
+	{
+		const std::size_t bytes = static_cast<std::size_t>(renderInfo.MaxX - renderInfo.MinX) * (renderInfo.MaxY - renderInfo.MinY) * sizeof(uint32_t);
+		if (queuedBytes + bytes > cache.GetBudget()) return false;
+		if (FindCachedTriangle(device.Atlas, cache, key) || stored.count(key) || queued.count(key)) return false;
+		if (!TakeRasterizationBudget(device, renderInfo)) return false;
+
+		queued.insert(key);
+		queuedBytes += bytes;
+		return true;
+	}
+
+	// The CPU half of the prepass: the whole frame is walked once before anything is drawn, and every triangle that is going to miss the
+	// cache is rasterized by the worker pool into the pixels of its job. This doesn't make a single SDL call, so it can run on any thread.
+	// UploadRasterizedMisses then puts the results into the cache on the thread of the renderer, and the actual drawing finds everything
+	// from the cache.
+	void RasterizeMisses(Device& device, const ImDrawData* drawData)
+	{
+		device.JobCount = 0;
+		device.QueuedUniformColorTriangles.clear();
+		device.QueuedGenericTriangles.clear();
+		device.QueuedPolygons.clear();
+
+		std::size_t queuedUniformColorBytes = 0, queuedGenericBytes = 0, queuedPolygonBytes = 0;
+
+		const auto queue = [&device](const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture) -> Device::RasterizationJob& {
+			if (device.JobCount == device.Jobs.size()) device.Jobs.emplace_back();
+
+			auto& job = device.Jobs[device.JobCount++];
+			job.V1 = v1;
+			job.V2 = v2;
+			job.V3 = v3;
+			job.SampledTexture = texture;
+			return job;
+		};
+
+		for (int n = 0; n < drawData->CmdListsCount; n++)
+		{
+			// Lists that are only copied from their retained texture don't draw any triangles.
+			if (device.DrawListPlans[n].Retained && device.DrawListPlans[n].IsUnchanged) continue;
+
+			const ImDrawList* commandList = drawData->CmdLists[n];
+			PrimitiveStream& stream = device.PrimitiveStreams[n];
+			ClassifyDrawList(device, commandList, stream);
+
+			for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
+			{
+				const ImDrawCmd* drawCommand = &commandList->CmdBuffer[cmd_i];
+				const Texture* texture = device.IsFontTexture(drawCommand->TextureId) ? &device.FontTexture : nullptr;
+
+				SDL_Rect visible;
+				if (!drawCommand->UserCallback && CalculateVisibleRect(CalculateClipRect(*drawCommand, 0, 0), UnboundedTarget, visible))
+				{
+					DrawPrimitives(stream, cmd_i, commandList->VtxBuffer.Data, commandList->IdxBuffer.Data, 0, 0, visible,
+						[](const Rect&, uint32_t, bool, bool) { },
+						[](const Rect&, const GradientCorners&) { return true; },
+						[&](const TriangleFan& fan) {
+							const auto& renderInfo = CalculatePolygonRenderInfo(fan);
+							if (IsMostlyClipped(renderInfo, visible)) return;
+
+							const auto key = MakeUniformColorPolygonKey(fan, renderInfo);
+							if (!ShouldQueue(device, device.PolygonCache, device.CacheFile.Polygons, device.QueuedPolygons, queuedPolygonBytes, key, renderInfo)) return;
+
+							auto& job = queue(fan.Vertex(0), fan.Vertex(1), fan.Vertex(2), nullptr);
+							job.Kind = Device::RasterizationJob::JobKind::Polygon;
+							job.OutlineKey = key;
+							job.Fan = fan;
+						},
+						[&](const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3) {
+							const auto& renderInfo = CalculateRenderInfo(v1, v2, v3);
+							if (IsSpanTriangle(device, renderInfo) || IsMostlyClipped(renderInfo, visible)) return;
+
+							const auto key = MakeUniformColorTriangleKey(v1, v2, v3, renderInfo);
+							if (!ShouldQueue(device, device.UniformColorTriangleCache, device.CacheFile.UniformColorTriangles, device.QueuedUniformColorTriangles, queuedUniformColorBytes, key, renderInfo)) return;
+
+							auto& job = queue(v1, v2, v3, nullptr);
+							job.Kind = Device::RasterizationJob::JobKind::UniformColorTriangle;
+							job.UniformColorKey = key;
+						},
+						[&](const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3) {
+							const auto& renderInfo = CalculateRenderInfo(v1, v2, v3);
+							if (IsMostlyClipped(renderInfo, visible)) return;
+
+							const auto key = MakeGenericTriangleKey(v1, v2, v3, renderInfo);
+							if (!ShouldQueue(device, device.GenericTriangleCache, device.CacheFile.Triangles, device.QueuedGenericTriangles, queuedGenericBytes, key, renderInfo)) return;
+
+							auto& job = queue(v1, v2, v3, texture);
+							job.Kind = Device::RasterizationJob::JobKind::Triangle;
+							job.GenericKey = key;
+						});
+				}
+			}
+		}
+
+		using JobKind = Device::RasterizationJob::JobKind;
+
+		{
+			ScopedTimer timer(device.Stats.RasterizationTime);
+			IMGUI_SDL_TRACE_ZONE("Rasterize misses", "jobs", static_cast<long long>(device.JobCount));
+			device.Workers.Run(device.JobCount, [&device](std::size_t index) {
+				auto& job = device.Jobs[index];
+
+				switch (job.Kind)
+				{
+				case JobKind::UniformColorTriangle:
+					job.IsCovered = RasterizeUniformColorTriangle(job.V1.col, CalculateRenderInfo(job.V1, job.V2, job.V3), job.Pixels);
+					break;
+				case JobKind::Triangle:
+					job.IsCovered = RasterizeTriangle(job.V1, job.V2, job.V3, job.SampledTexture, CalculateRenderInfo(job.V1, job.V2, job.V3), job.Pixels);
+					break;
+				case JobKind::Polygon:
+					job.IsCovered = RasterizeUniformColorPolygon(job.V1.col, CalculatePolygonRenderInfo(job.Fan), job.Pixels);
+					break;
+				}
+			});
+		}
+	}
+
+	// The SDL half of the prepass. The jobs are uploaded and inserted in the order they were found in, so the result doesn't depend on the
+	// number of threads.
+	void UploadRasterizedMisses(Device& device)
+	{
+		IMGUI_SDL_TRACE_ZONE("Upload misses", "jobs", static_cast<long long>(device.JobCount));
+		using JobKind = Device::RasterizationJob::JobKind;
+
+		for (std::size_t i = 0; i < device.JobCount; i++)
+		{
+			const auto& job = device.Jobs[i];
+			if (!job.IsCovered) continue;
+
+			auto cached = job.Kind == JobKind::Polygon
+				? StoreTriangle(device, CalculatePolygonRenderInfo(job.Fan), job.Pixels.data())
+				: StoreTriangle(device, CalculateRenderInfo(job.V1, job.V2, job.V3), job.Pixels.data());
+			cached.IsPendingMiss = true;
+			device.Stats.RasterizedPixels += static_cast<long long>(cached.Width) * cached.Height;
+			const std::size_t bytes = cached.Bytes();
+
+			switch (job.Kind)
+			{
+			case JobKind::UniformColorTriangle:
+				device.UniformColorTriangleCache.Insert(job.UniformColorKey, std::move(cached), bytes);
+				break;
+			case JobKind::Triangle:
+				device.GenericTriangleCache.Insert(job.GenericKey, std::move(cached), bytes);
+				break;
+			case JobKind::Polygon:
+				device.PolygonCache.Insert(job.OutlineKey, std::move(cached), bytes);
+				break;
+			}
+		}
+
+		device.JobCount = 0;
+	}
+
+	bool DrawGeometry(Device& device, const ImDrawVert* vertices, int vertexCount, const ImDrawIdx* indexBuffer, const ImDrawCmd* drawCommand)
 	{
-		const Color color(v1.col);
+		SDL_Texture* texture = device.IsFontTexture(drawCommand->TextureId) ? device.FontTexture.Source : static_cast<SDL_Texture*>(drawCommand->TextureId);
+
+		// The whole command goes to SDL in one call, with the vertex attributes read straight out of the ImDrawVert array.
+		const int stride = static_cast<int>(sizeof(ImDrawVert));
+
+		device.Stats.SDLCalls++;
 
-		// The naming inconsistency in the parameters is intentional. The fixed point algorithm wants the vertices in a counter clockwise order.
-		const auto& renderInfo = FixedPointTriangleRenderInfo::CalculateFixedPointTriangleInfo(v3.pos, v2.pos, v1.pos);
+		const int result = device.RenderGeometryRaw(device.Renderer, texture,
+			&vertices->pos.x, stride,
+			reinterpret_cast<const SDL_Color*>(&vertices->col), stride,
+			&vertices->uv.x, stride,
+			vertexCount,
+			indexBuffer, static_cast<int>(drawCommand->ElemCount), static_cast<int>(sizeof(ImDrawIdx)));
 
-		const auto key =std::make_tuple(v1.col,
-			static_cast<int>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v1.pos.y)) - renderInfo.MinY,
-			static_cast<int>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v2.pos.y)) - renderInfo.MinY,
-			static_cast<int>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v3.pos.y)) - renderInfo.MinY);
-		if (CurrentDevice->UniformColorTriangleCache.Contains(key))
+		// Some render drivers don't implement geometry even on new SDL versions. In that case we permanently switch over to the rasterizer.
+		if (result < 0)
 		{
-			const auto& cached = CurrentDevice->UniformColorTriangleCache.At(key);
-			DrawCachedTriangle(*cached, renderInfo);
+			device.RenderGeometryRaw = nullptr;
+			return false;
+		}
 
-			return;
+		device.Stats.GeometryCommands++;
+		return true;
+	}
+
+	// Draws the commands of a list with the given vertices, which are either the ones of the list or a copy of them moved by the offset. The
+	// stream is only built if a command turns out to need the rasterizer, since SDL_RenderGeometry draws straight from the list.
+	void DrawCommands(Device& device, const ImDrawList* commandList, PrimitiveStream& stream, const ImDrawVert* vertices, int offsetX, int offsetY)
+	{
+		const ImDrawIdx* indexBuffer = commandList->IdxBuffer.Data;
+		const SDL_Rect target = CalculateRenderTarget(device);
+
+		for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
+		{
+			const ImDrawCmd* drawCommand = &commandList->CmdBuffer[cmd_i];
+			IMGUI_SDL_TRACE_ZONE("Draw command", "elements", drawCommand->ElemCount);
+
+			const SDL_Rect clipRect = CalculateClipRect(*drawCommand, offsetX, offsetY);
+			SDL_Rect visible;
+			const bool isVisible = CalculateVisibleRect(clipRect, target, visible);
+
+			// A scrolled list puts most of its rows outside of the clip rect of its window, and those are dropped right here, before
+			// anything gets looked up or rasterized for them.
+			if (!drawCommand->UserCallback && !isVisible)
+			{
+				device.Stats.CulledCommands++;
+				indexBuffer += drawCommand->ElemCount;
+				continue;
+			}
+
+			device.State.SetClipRect(&clipRect);
+
+			if (drawCommand->UserCallback)
+			{
+				drawCommand->UserCallback(commandList, drawCommand);
+				device.State.Forget();
+			}
+			else if (device.UseGeometry() && DrawGeometry(device, vertices, commandList->VtxBuffer.Size, indexBuffer, drawCommand))
+			{
+				// SDL drew the whole command for us.
+			}
+			else
+			{
+				const bool isWrappedTexture = device.IsFontTexture(drawCommand->TextureId);
+
+				ClassifyDrawList(device, commandList, stream);
+				device.Stats.CulledTriangles += DrawPrimitives(stream, cmd_i, vertices, commandList->IdxBuffer.Data, offsetX, offsetY, visible,
+					[&](const Rect& bounding, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip) {
+						device.Stats.Rectangles++;
+						if (isWrappedTexture)
+						{
+							DrawRectangle(device, bounding, &device.FontTexture, color, doHorizontalFlip, doVerticalFlip);
+						}
+						else
+						{
+							DrawRectangle(device, bounding, static_cast<SDL_Texture*>(drawCommand->TextureId), color, doHorizontalFlip, doVerticalFlip);
+						}
+					},
+					[&](const Rect& bounding, const GradientCorners& corners) {
+						return DrawGradientRectangle(device, bounding, corners, clipRect);
+					},
+					[&](const TriangleFan& fan) {
+						DrawUniformColorPolygon(device, fan, visible);
+					},
+					[&](const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2) {
+						DrawUniformColorTriangle(device, v0, v1, v2, visible);
+					},
+					[&](const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2) {
+						// Currently we assume that any non rectangular texture samples the font texture. Dunno if that's what actually happens, but it seems to work.
+						assert(isWrappedTexture);
+						DrawTriangle(device, v0, v1, v2, &device.FontTexture, visible);
+					});
+
+				// The next command may change the clip rect, so the batch can't carry over to it.
+				FlushDraws(device);
+			}
+
+			indexBuffer += drawCommand->ElemCount;
 		}
+	}
+
+	// Puts the triangle or polygon that was just rasterized into the scratch buffer of the device into the framebuffer.
+	template <typename RenderInfo> void CopyRasterized(Device& device, FramebufferTarget& target, const RenderInfo& renderInfo)
+	{
+		const int width = renderInfo.MaxX - renderInfo.MinX;
+		const int height = renderInfo.MaxY - renderInfo.MinY;
+		device.Stats.RasterizedPixels += static_cast<long long>(width) * height;
+		target.Copy(device.PixelBuffer.data(), renderInfo.MinX, renderInfo.MinY, width, height);
+	}
+
+	// The framebuffer version of DrawCommands. The caches hold textures that only a renderer can draw, so triangles are rasterized every
+	// frame and copied from the scratch buffer. Commands with textures other than the font are skipped, since the pixels of an SDL_Texture
+	// can't be read back.
+	void DrawCommandsInto(Device& device, FramebufferTarget& target, const ImDrawList* commandList, PrimitiveStream& stream)
+	{
+		const Texture& font = device.FontTexture;
+		ClassifyDrawList(device, commandList, stream);
+
+		for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
+		{
+			const ImDrawCmd* drawCommand = &commandList->CmdBuffer[cmd_i];
+			IMGUI_SDL_TRACE_ZONE("Draw command", "elements", drawCommand->ElemCount);
+
+			if (drawCommand->UserCallback)
+			{
+				drawCommand->UserCallback(commandList, drawCommand);
+			}
+			else if (device.IsFontTexture(drawCommand->TextureId))
+			{
+				target.SetClipRect(CalculateClipRect(*drawCommand, 0, 0));
 
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
-		DrawTriangleWithColorFunction(renderInfo, [&color](float, float) { return color; }, cached.get());
+				// The clip rect of the target is already limited to the framebuffer, and nothing outside of it needs to be rasterized, as
+				// none of it is cached anyway.
+				const SDL_Rect& visible = target.GetClipRect();
+				if (visible.w <= 0 || visible.h <= 0)
+				{
+					device.Stats.CulledCommands++;
+					continue;
+				}
 
-		if (!cached->Texture) return;
+				device.Stats.CulledTriangles += DrawPrimitives(stream, cmd_i, commandList->VtxBuffer.Data, commandList->IdxBuffer.Data, 0, 0, visible,
+					[&](const Rect& bounding, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip) {
+						device.Stats.Rectangles++;
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+						// The color goes through the same conversion as when it's handed to SDL, so both come out the same.
+						if (bounding.UsesOnlyColor(font.WhitePixel))
+						{
+							target.Fill(bounding.Destination(), Color(color).ToBytes());
+						}
+						else
+						{
+							target.Copy(font, bounding.Source(font.Surface->w, font.Surface->h), bounding.Destination(),
+								Rect::Flip(doHorizontalFlip, doVerticalFlip), Color(color).ToBytes());
+						}
+					},
+					[&](const Rect& bounding, const GradientCorners& corners) {
+						device.Stats.GradientRectangles++;
+						target.FillGradient(bounding.Destination(), corners);
+						return true;
+					},
+					[&](const TriangleFan& fan) {
+						device.Stats.Polygons++;
+						auto renderInfo = CalculatePolygonRenderInfo(fan);
+						ClipRenderInfo(renderInfo, visible);
+						if (MeasureRasterization(device, [&] { return RasterizeUniformColorPolygon(fan.Vertex(0).col, renderInfo, device.PixelBuffer); }))
+						{
+							CopyRasterized(device, target, renderInfo);
+						}
+					},
+					[&](const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2) {
+						device.Stats.UniformColorTriangles++;
+						auto renderInfo = CalculateRenderInfo(v0, v1, v2);
+						ClipRenderInfo(renderInfo, visible);
+						if (MeasureRasterization(device, [&] { return RasterizeUniformColorTriangle(v0.col, renderInfo, device.PixelBuffer); }))
+						{
+							CopyRasterized(device, target, renderInfo);
+						}
+					},
+					[&](const ImDrawVert& v0, const ImDrawVert& v1, const ImDrawVert& v2) {
+						device.Stats.GenericTriangles++;
+						auto renderInfo = CalculateRenderInfo(v0, v1, v2);
+						ClipRenderInfo(renderInfo, visible);
+						if (MeasureRasterization(device, [&] { return RasterizeTriangle(v0, v1, v2, &font, renderInfo, device.PixelBuffer); }))
+						{
+							CopyRasterized(device, target, renderInfo);
+						}
+					});
+			}
+		}
+	}
 
-		CurrentDevice->UniformColorTriangleCache.Insert(key, std::move(cached));
+	// Drawing over transparent black with the usual blending leaves premultiplied colors in the texture, so it has to be blended with the
+	// screen as such. Custom blend modes only exist since SDL 2.0.6, which is why retention needs at least that.
+	SDL_BlendMode PremultipliedAlphaBlendMode()
+	{
+#if SDL_VERSION_ATLEAST(2, 0, 6)
+		return SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+			SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+#else
+		return SDL_BLENDMODE_BLEND;
+#endif
 	}
 
-	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, int textureWidth, int textureHeight, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	// Makes sure the texture of the list is at least the given size. Textures only ever grow, and in steps of 64 pixels, so that a window
+	// that is being resized doesn't get a new texture every frame.
+	bool ReserveRetainedTexture(Device& device, RetainedDrawList& retained, int width, int height)
 	{
-		// We are safe to assume uniform color here, because the caller checks it and and uses the triangle renderer to render those.
+		if (retained.Texture && width <= retained.TextureWidth && height <= retained.TextureHeight) return true;
 
-		const SDL_Rect destination = {
-			static_cast<int>(bounding.MinX),
-			static_cast<int>(bounding.MinY),
-			static_cast<int>(bounding.MaxX - bounding.MinX),
-			static_cast<int>(bounding.MaxY - bounding.MinY)
-		};
+		IMGUI_SDL_TRACE_ZONE("Create retained texture", "pixels", static_cast<long long>(width) * height);
 
-		// If the area isn't textured, we can just draw a rectangle with the correct color.
-		if (bounding.UsesOnlyColor())
+		// The bounds never go over the biggest texture the renderer can make, but rounding them up could.
+		const int textureWidth = std::min((std::max(width, retained.TextureWidth) + 63) & ~63, device.MaxRetainedTextureWidth);
+		const int textureHeight = std::min((std::max(height, retained.TextureHeight) + 63) & ~63, device.MaxRetainedTextureHeight);
+		if (retained.FailedWidth > 0 && textureWidth >= retained.FailedWidth && textureHeight >= retained.FailedHeight) return false;
+
+		if (retained.Texture) SDL_DestroyTexture(retained.Texture);
+		retained.Texture = CreateTexture(device.Renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, textureWidth, textureHeight);
+		retained.TextureWidth = retained.TextureHeight = 0;
+		retained.IsValid = false;
+		device.Stats.SDLCalls++;
+		if (!retained.Texture)
+		{
+			retained.FailedWidth = textureWidth;
+			retained.FailedHeight = textureHeight;
+			return false;
+		}
+
+		// The software renderer, for one, can draw into textures but can't blend them like this. Then there's no point in trying again.
+		if (SDL_SetTextureBlendMode(retained.Texture, PremultipliedAlphaBlendMode()) != 0)
+		{
+			device.CanRetainDrawLists = false;
+			return false;
+		}
+		device.Stats.SDLCalls++;
+
+		retained.TextureWidth = textureWidth;
+		retained.TextureHeight = textureHeight;
+		return true;
+	}
+
+	// Puts a retained list on the screen, drawing it into its texture first if it changed. Returns false if that texture couldn't be made,
+	// in which case the list has to be drawn directly.
+	bool DrawRetainedDrawList(Device& device, const ImDrawList* commandList, PrimitiveStream& stream, const DrawListPlan& plan, SDL_Texture* screen)
+	{
+		if (!device.CanRetainDrawLists) return false;
+
+		// A list whose texture couldn't be made is kept as well, so that it remembers not to try again.
+		RetainedDrawList& retained = *plan.Retained;
+		retained.LastFrame = device.Frame;
+		if (plan.IsUnchanged)
 		{
-			color.UseAsDrawColor(CurrentDevice->Renderer);
-			SDL_RenderFillRect(CurrentDevice->Renderer, &destination);
+			device.Stats.DrawListCache.Hits++;
 		}
 		else
 		{
-			// We can now just calculate the correct source rectangle and draw it.
+			if (!ReserveRetainedTexture(device, retained, plan.Bounds.w, plan.Bounds.h)) return false;
+			device.Stats.DrawListCache.Misses++;
 
-			const SDL_Rect source = {
-				static_cast<int>(bounding.MinU * textureWidth),
-				static_cast<int>(bounding.MinV * textureHeight),
-				static_cast<int>((bounding.MaxU - bounding.MinU) * textureWidth),
-				static_cast<int>((bounding.MaxV - bounding.MinV) * textureHeight)
-			};
+			device.TranslatedVertices.assign(commandList->VtxBuffer.begin(), commandList->VtxBuffer.end());
+			for (ImDrawVert& vertex : device.TranslatedVertices)
+			{
+				vertex.pos.x -= static_cast<float>(plan.Bounds.x);
+				vertex.pos.y -= static_cast<float>(plan.Bounds.y);
+			}
+
+			device.State.SetTarget(retained.Texture);
+			device.State.SetDrawColor(0);
+			SDL_RenderClear(device.Renderer);
+			device.Stats.SDLCalls++;
+
+			const int standIns = device.Stats.StandIns;
+			DrawCommands(device, commandList, stream, device.TranslatedVertices.data(), plan.Bounds.x, plan.Bounds.y);
+			device.State.SetTarget(screen);
+
+			// A texture with stand-ins in it would keep them for as long as the list stays the same, so it's drawn again next frame.
+			retained.Hash = plan.Hash;
+			retained.IsValid = device.Stats.StandIns == standIns;
+		}
+
+		const SDL_Rect source = { 0, 0, plan.Bounds.w, plan.Bounds.h };
+		device.State.SetClipRect(nullptr);
+
+		SDL_RenderCopy(device.Renderer, retained.Texture, &source, &plan.Bounds);
+		device.Stats.SDLCalls++;
+		return true;
+	}
 
-			const SDL_RendererFlip flip = static_cast<SDL_RendererFlip>((doHorizontalFlip ? SDL_FLIP_HORIZONTAL : 0) | (doVerticalFlip ? SDL_FLIP_VERTICAL : 0));
+	// Lists that weren't in the frame belong to windows that were closed or hidden, so their textures go.
+	void ReleaseUnusedDrawLists(Device& device)
+	{
+		if (!device.CanRetainDrawLists)
+		{
+			device.RetainedDrawLists.clear();
+			return;
+		}
 
-			SDL_SetTextureColorMod(texture, static_cast<uint8_t>(color.R * 255), static_cast<uint8_t>(color.G * 255), static_cast<uint8_t>(color.B * 255));
-			SDL_RenderCopyEx(CurrentDevice->Renderer, texture, &source, &destination, 0.0, nullptr, flip);
+		for (auto entry = device.RetainedDrawLists.begin(); entry != device.RetainedDrawLists.end();)
+		{
+			if (entry->second.LastFrame != device.Frame) entry = device.RetainedDrawLists.erase(entry);
+			else ++entry;
 		}
 	}
 
-	void DrawRectangle(const Rect& bounding, const Texture* texture, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	// Clears the stats for a new frame. Evictions are counted by the caches over their whole lifetime, so we remember where they were at.
+	void StartFrameStats(Device& device)
 	{
-		DrawRectangle(bounding, texture->Source, texture->Surface->w, texture->Surface->h, color, doHorizontalFlip, doVerticalFlip);
+		device.Stats = ImGuiSDL::FrameStats();
+		device.SpentRasterizationBudget = 0;
+
+		device.InitialEvictions = {{
+			device.UniformColorTriangleCache.GetEvictionCount(),
+			device.GenericTriangleCache.GetEvictionCount(),
+			device.PolygonCache.GetEvictionCount()
+		}};
 	}
 
-	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	template <typename Cache> void FinishCacheStats(ImGuiSDL::FrameStats::CacheStats& stats, const Cache& cache, std::size_t initialEvictions)
 	{
-		int width, height;
-		SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
-		DrawRectangle(bounding, texture, width, height, color, doHorizontalFlip, doVerticalFlip);
+		stats.Evictions = static_cast<int>(cache.GetEvictionCount() - initialEvictions);
+		stats.Entries = static_cast<int>(cache.GetCount());
+		stats.UsedBytes = static_cast<long long>(cache.GetUsedBytes());
+		stats.BudgetBytes = static_cast<long long>(cache.GetBudget());
+	}
+
+	// The total time is added to whatever Prepare already spent on the frame.
+	void FinishFrameStats(Device& device, Uint64 startTime)
+	{
+		ImGuiSDL::FrameStats& stats = device.Stats;
+
+		FinishCacheStats(stats.UniformColorTriangleCache, device.UniformColorTriangleCache, device.InitialEvictions[0]);
+		FinishCacheStats(stats.GenericTriangleCache, device.GenericTriangleCache, device.InitialEvictions[1]);
+		FinishCacheStats(stats.PolygonCache, device.PolygonCache, device.InitialEvictions[2]);
+		stats.AtlasPages = static_cast<int>(device.Atlas.GetPageCount());
+
+		stats.DrawListCache.Entries = static_cast<int>(device.RetainedDrawLists.size());
+		for (const auto& entry : device.RetainedDrawLists) stats.DrawListCache.UsedBytes += static_cast<long long>(entry.second.Bytes());
+
+		stats.IsConverging = stats.StandIns > 0;
+
+		stats.TotalTime += MillisecondsSince(startTime);
+		stats.DrawingTime = std::max(0.0, stats.TotalTime - stats.ClassificationTime - stats.RasterizationTime - stats.UploadTime - stats.SubmissionTime);
+
+		// The history is a ring buffer, so the oldest frame is the one that gets overwritten.
+		device.StatsHistory[device.StatsHistoryCount % Device::StatsHistorySize] = stats;
+		device.StatsHistoryCount++;
+	}
+
+	// Once for every full stats history, the caches that didn't evict anything shrink towards what they actually use, and the memory they
+	// give up goes to the ones that did, in proportion to their misses. A cache that was shrunk and starts missing again gets a share too,
+	// up to its configured budget, so that it doesn't have to evict before it can grow back. Caches only grow into memory that another one
+	// gave up, so the total stays within the configured budgets.
+	void AdaptCacheBudgets(Device& device)
+	{
+		if (device.StatsHistoryCount % Device::StatsHistorySize != 0) return;
+
+		// A cache never shrinks below this, so that one that sits idle for a while can still get going again.
+		static constexpr std::size_t minimumBudget = 256 << 10;
+
+		const ImGuiSDL::FrameStats::CacheStats ImGuiSDL::FrameStats::* const members[3] = {
+			&ImGuiSDL::FrameStats::UniformColorTriangleCache, &ImGuiSDL::FrameStats::GenericTriangleCache, &ImGuiSDL::FrameStats::PolygonCache
+		};
+		std::size_t budgets[3] = { device.UniformColorTriangleCache.GetBudget(), device.GenericTriangleCache.GetBudget(), device.PolygonCache.GetBudget() };
+		const std::size_t configured[3] = {
+			device.Configuration.UniformColorTriangleCacheBytes, device.Configuration.GenericTriangleCacheBytes, device.Configuration.PolygonCacheBytes
+		};
+		const std::size_t used[3] = { device.UniformColorTriangleCache.GetUsedBytes(), device.GenericTriangleCache.GetUsedBytes(), device.PolygonCache.GetUsedBytes() };
+
+		long long misses[3] = {}, evictions[3] = {};
+		for (const auto& stats : device.StatsHistory)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				misses[i] += (stats.*members[i]).Misses;
+				evictions[i] += (stats.*members[i]).Evictions;
+			}
+		}
+
+		// The shares of the spare memory. The ones of the caches that are growing back are only as big as their misses, so that missing
+		// now and then doesn't take away as much as evicting does.
+		long long shares[3] = {}, totalShares = 0;
+		std::size_t assigned = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const bool isShrunk = budgets[i] < configured[i];
+			if (evictions[i] == 0) budgets[i] = std::min(budgets[i], std::max(minimumBudget, used[i] + used[i] / 4));
+
+			if (evictions[i] > 0) shares[i] = misses[i] + 1;
+			else if (isShrunk) shares[i] = misses[i];
+			totalShares += shares[i];
+			assigned += budgets[i];
+		}
+
+		const std::size_t total = device.TotalCacheBudget();
+		if (totalShares > 0 && assigned < total)
+		{
+			const double spare = static_cast<double>(total - assigned);
+			for (int i = 0; i < 3; i++)
+			{
+				const std::size_t grown = budgets[i] + static_cast<std::size_t>(spare * shares[i] / totalShares);
+				budgets[i] = evictions[i] > 0 ? grown : std::max(budgets[i], std::min(grown, configured[i]));
+			}
+		}
+
+		device.UniformColorTriangleCache.SetBudget(budgets[0]);
+		device.GenericTriangleCache.SetBudget(budgets[1]);
+		device.PolygonCache.SetBudget(budgets[2]);
+	}
+
+	// Calls the function with every pair of matching counters of the two stats.
+	template <typename Function> void ForEachCounter(ImGuiSDL::FrameStats& a, const ImGuiSDL::FrameStats& b, const Function& function)
+	{
+		function(a.Rectangles, b.Rectangles);
+		function(a.GradientRectangles, b.GradientRectangles);
+		function(a.Polygons, b.Polygons);
+		function(a.UniformColorTriangles, b.UniformColorTriangles);
+		function(a.SpanTriangles, b.SpanTriangles);
+		function(a.GenericTriangles, b.GenericTriangles);
+		function(a.GeometryCommands, b.GeometryCommands);
+		function(a.CulledCommands, b.CulledCommands);
+		function(a.CulledTriangles, b.CulledTriangles);
+		function(a.ClippedTriangles, b.ClippedTriangles);
+		function(a.StandIns, b.StandIns);
+
+		for (auto cache : { &ImGuiSDL::FrameStats::UniformColorTriangleCache, &ImGuiSDL::FrameStats::GenericTriangleCache, &ImGuiSDL::FrameStats::PolygonCache, &ImGuiSDL::FrameStats::DrawListCache })
+		{
+			function((a.*cache).Hits, (b.*cache).Hits);
+			function((a.*cache).Misses, (b.*cache).Misses);
+			function((a.*cache).Evictions, (b.*cache).Evictions);
+			function((a.*cache).Entries, (b.*cache).Entries);
+			function((a.*cache).UsedBytes, (b.*cache).UsedBytes);
+			function((a.*cache).BudgetBytes, (b.*cache).BudgetBytes);
+		}
+
+		function(a.CacheFileHits, b.CacheFileHits);
+		function(a.AtlasPages, b.AtlasPages);
+		function(a.AtlasEvictions, b.AtlasEvictions);
+		function(a.RasterizedPixels, b.RasterizedPixels);
+		function(a.SDLCalls, b.SDLCalls);
+		function(a.ElidedSDLCalls, b.ElidedSDLCalls);
+
+		function(a.ClassificationTime, b.ClassificationTime);
+		function(a.DrawingTime, b.DrawingTime);
+		function(a.RasterizationTime, b.RasterizationTime);
+		function(a.UploadTime, b.UploadTime);
+		function(a.SubmissionTime, b.SubmissionTime);
+		function(a.TotalTime, b.TotalTime);
 	}
+
+	struct AddCounter
+	{
+		template <typename T> void operator()(T& sum, const T& value) const { sum += value; }
+	};
+
+	// Integer counters are rounded to the nearest value.
+	struct DivideCounter
+	{
+		double Count;
+
+		template <typename T> void operator()(T& sum, const T&) const
+		{
+			sum = static_cast<T>(sum / Count + (std::is_integral<T>::value ? 0.5 : 0.0));
+		}
+	};
 }
 
 namespace ImGuiSDL
 {
+	// A context is just a device under the name the interface knows it by.
+	struct Context : Device
+	{
+		using Device::Device;
+	};
+
 	void Initialize(SDL_Renderer* renderer, int windowWidth, int windowHeight)
+	{
+		Initialize(renderer, windowWidth, windowHeight, Options());
+	}
+
+	void Initialize(SDL_Renderer* renderer, int windowWidth, int windowHeight, const Options& options)
 	{
 		ImGuiIO& io = ImGui::GetIO();
 		io.DisplaySize.x = static_cast<float>(windowWidth);
@@ -525,152 +4595,274 @@ namespace ImGuiSDL
 		ImGui::GetStyle().AntiAliasedFill = false;
 		ImGui::GetStyle().AntiAliasedLines = false;
 
-		// Loads the font texture.
-		unsigned char* pixels;
-		int width, height;
-		io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
-		static constexpr uint32_t rmask = 0x000000ff, gmask = 0x0000ff00, bmask = 0x00ff0000, amask = 0xff000000;
-		SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(pixels, width, height, 32, 4 * width, rmask, gmask, bmask, amask);
+		DefaultContext = CreateContext(renderer, io.Fonts, options);
+	}
 
-		Texture* texture = new Texture();
-		texture->Surface = surface;
-		texture->Source = SDL_CreateTextureFromSurface(renderer, surface);
-		io.Fonts->TexID = (void*)texture;
+	void Deinitialize()
+	{
+		DestroyContext(DefaultContext);
+		DefaultContext = nullptr;
+	}
 
-		CurrentDevice = new Device(renderer);
+	void Render(ImDrawData* drawData)
+	{
+		Render(DefaultContext, drawData);
 	}
 
-	void Deinitialize()
+	void SetOptions(const Options& options)
 	{
-		// Frees up the memory of the font texture.
-		ImGuiIO& io = ImGui::GetIO();
-		Texture* texture = static_cast<Texture*>(io.Fonts->TexID);
-		delete texture;
+		SetOptions(DefaultContext, options);
+	}
 
-		delete CurrentDevice;
+	const Options& GetOptions()
+	{
+		return GetOptions(DefaultContext);
 	}
 
-	void Render(ImDrawData* drawData)
+	void SetRasterizerThreadCount(int count)
+	{
+		Options options = GetOptions();
+		options.RasterizerThreadCount = count;
+		SetOptions(options);
+	}
+
+	bool SetRenderMode(RenderMode mode)
+	{
+		Options options = GetOptions();
+		options.Mode = mode;
+		SetOptions(options);
+		return mode != RenderMode::Geometry || DefaultContext->RenderGeometryRaw;
+	}
+
+	const FrameStats& GetFrameStats()
 	{
-		SDL_BlendMode blendMode;
-		SDL_GetRenderDrawBlendMode(CurrentDevice->Renderer, &blendMode);
-		SDL_SetRenderDrawBlendMode(CurrentDevice->Renderer, SDL_BLENDMODE_BLEND);
+		return GetFrameStats(DefaultContext);
+	}
 
-		Uint8 initialR, initialG, initialB, initialA;
-		SDL_GetRenderDrawColor(CurrentDevice->Renderer, &initialR, &initialG, &initialB, &initialA);
+	FrameStats GetAverageFrameStats()
+	{
+		return GetAverageFrameStats(DefaultContext);
+	}
 
-		SDL_bool initialClipEnabled = SDL_RenderIsClipEnabled(CurrentDevice->Renderer);
-		SDL_Rect initialClipRect;
-		SDL_RenderGetClipRect(CurrentDevice->Renderer, &initialClipRect);
+	void ShowStatsWindow(bool* open)
+	{
+		ShowStatsWindow(DefaultContext, open);
+	}
 
-		SDL_Texture* initialRenderTarget = SDL_GetRenderTarget(CurrentDevice->Renderer);
+	Context* CreateContext(SDL_Renderer* renderer, ImFontAtlas* fonts, const Options& options)
+	{
+		Context* context = new Context(renderer, fonts, options);
 
-		ImGuiIO& io = ImGui::GetIO();
+		// The first context to use an atlas gets to give it its TexID. Any other context that shares the atlas recognizes the font by that
+		// same TexID, but draws it out of its own copy.
+		if (!fonts->TexID) fonts->TexID = static_cast<ImTextureID>(&context->FontTexture);
 
-		for (int n = 0; n < drawData->CmdListsCount; n++)
+		return context;
+	}
+
+	void DestroyContext(Context* context)
+	{
+		if (!context) return;
+
+		if (context->Fonts->TexID == static_cast<ImTextureID>(&context->FontTexture)) context->Fonts->TexID = nullptr;
+		delete context;
+	}
+
+	void SetOptions(Context* context, const Options& options)
+	{
+		context->ApplyOptions(options);
+	}
+
+	const Options& GetOptions(Context* context)
+	{
+		return context->Configuration;
+	}
+
+	const FrameStats& GetFrameStats(Context* context)
+	{
+		return context->Stats;
+	}
+
+	FrameStats GetAverageFrameStats(Context* context)
+	{
+		const Device& device = *context;
+		const std::size_t count = std::min(device.StatsHistoryCount, Device::StatsHistorySize);
+
+		FrameStats average;
+		if (count == 0) return average;
+
+		for (std::size_t i = 0; i < count; i++) ForEachCounter(average, device.StatsHistory[i], AddCounter());
+		ForEachCounter(average, average, DivideCounter{ static_cast<double>(count) });
+
+		// Whether the UI is still converging is about where it is now, not about how it got there.
+		average.IsConverging = device.StatsHistory[(device.StatsHistoryCount - 1) % Device::StatsHistorySize].IsConverging;
+		return average;
+	}
+
+	void ShowStatsWindow(Context* context, bool* open)
+	{
+		if (!ImGui::Begin("ImGuiSDL Stats", open, ImGuiWindowFlags_AlwaysAutoResize))
 		{
-			auto commandList = drawData->CmdLists[n];
-			auto vertexBuffer = commandList->VtxBuffer;
-			auto indexBuffer = commandList->IdxBuffer.Data;
+			ImGui::End();
+			return;
+		}
 
-			for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
-			{
-				const ImDrawCmd* drawCommand = &commandList->CmdBuffer[cmd_i];
+		const FrameStats stats = GetAverageFrameStats(context);
+		const auto showCache = [](const char* name, const FrameStats::CacheStats& cache) {
+			ImGui::Text("%s: %d hits, %d misses, %d evictions, %d entries, %lld/%lld KB", name, cache.Hits, cache.Misses, cache.Evictions, cache.Entries,
+				cache.UsedBytes / 1024, cache.BudgetBytes / 1024);
+		};
 
-				const Device::ClipRect clipRect = {
-					static_cast<int>(drawCommand->ClipRect.x),
-					static_cast<int>(drawCommand->ClipRect.y),
-					static_cast<int>(drawCommand->ClipRect.z - drawCommand->ClipRect.x),
-					static_cast<int>(drawCommand->ClipRect.w - drawCommand->ClipRect.y)
-				};
-				CurrentDevice->SetClipRect(clipRect);
+		ImGui::Text("Averaged over the last %d frames", static_cast<int>(std::min(context->StatsHistoryCount, Device::StatsHistorySize)));
+		ImGui::Separator();
+
+		ImGui::Text("Total: %.3f ms", stats.TotalTime);
+		ImGui::Text("Classification: %.3f ms", stats.ClassificationTime);
+		ImGui::Text("Drawing: %.3f ms", stats.DrawingTime);
+		ImGui::Text("Rasterization: %.3f ms", stats.RasterizationTime);
+		ImGui::Text("Upload: %.3f ms", stats.UploadTime);
+		ImGui::Text("Submission: %.3f ms", stats.SubmissionTime);
+		ImGui::Separator();
+
+		ImGui::Text("Rectangles: %d", stats.Rectangles);
+		ImGui::Text("Gradient rectangles: %d", stats.GradientRectangles);
+		ImGui::Text("Polygons: %d", stats.Polygons);
+		ImGui::Text("Uniform color triangles: %d", stats.UniformColorTriangles);
+		ImGui::Text("Span triangles: %d", stats.SpanTriangles);
+		ImGui::Text("Generic triangles: %d", stats.GenericTriangles);
+		ImGui::Text("Geometry commands: %d", stats.GeometryCommands);
+		ImGui::Text("Culled: %d commands, %d triangles, %d clipped", stats.CulledCommands, stats.CulledTriangles, stats.ClippedTriangles);
+		ImGui::Text("Stand-ins: %d%s", stats.StandIns, stats.IsConverging ? ", converging" : "");
+		ImGui::Text("Rasterized pixels: %lld", stats.RasterizedPixels);
+		ImGui::Text("SDL calls: %d, %d elided", stats.SDLCalls, stats.ElidedSDLCalls);
+		ImGui::Separator();
+
+		showCache("Uniform color triangle cache", stats.UniformColorTriangleCache);
+		showCache("Generic triangle cache", stats.GenericTriangleCache);
+		showCache("Polygon cache", stats.PolygonCache);
+		ImGui::Text("Cache file: %d hits", stats.CacheFileHits);
+		ImGui::Text("Atlas: %d pages, %d evictions", stats.AtlasPages, stats.AtlasEvictions);
+		ImGui::Text("Retained draw lists: %d hits, %d misses, %d entries, %lld KB", stats.DrawListCache.Hits, stats.DrawListCache.Misses,
+			stats.DrawListCache.Entries, stats.DrawListCache.UsedBytes / 1024);
+
+		ImGui::End();
+	}
 
-				if (drawCommand->UserCallback)
-				{
-					drawCommand->UserCallback(commandList, drawCommand);
-				}
-				else
-				{
-					const bool isWrappedTexture = drawCommand->TextureId == io.Fonts->TexID;
+	void StartTrace()
+	{
+#if IMGUI_SDL_TRACE
+		Tracer::Get().Start();
+#endif
+	}
 
-					// Loops over triangles.
-					for (unsigned int i = 0; i + 3 <= drawCommand->ElemCount; i += 3)
-					{
-						const ImDrawVert& v0 = vertexBuffer[indexBuffer[i + 0]];
-						const ImDrawVert& v1 = vertexBuffer[indexBuffer[i + 1]];
-						const ImDrawVert& v2 = vertexBuffer[indexBuffer[i + 2]];
+	void StopTrace()
+	{
+#if IMGUI_SDL_TRACE
+		Tracer::Get().Stop();
+#endif
+	}
+
+	bool WriteTrace(const char* path)
+	{
+#if IMGUI_SDL_TRACE
+		return Tracer::Get().Write(path);
+#else
+		(void)path;
+		return false;
+#endif
+	}
 
-						const Rect& bounding = Rect::CalculateBoundingBox(v0, v1, v2);
+	void Prepare(Context* context, ImDrawData* drawData)
+	{
+		IMGUI_SDL_TRACE_FRAME();
+		IMGUI_SDL_TRACE_ZONE("Prepare", "lists", drawData->CmdListsCount);
+		Device& device = *context;
+		const Uint64 startTime = SDL_GetPerformanceCounter();
 
-						const bool isTriangleUniformColor = v0.col == v1.col && v1.col == v2.col;
-						const bool doesTriangleUseOnlyColor = bounding.UsesOnlyColor();
+		StartFrameStats(device);
+		PlanDrawLists(device, drawData);
+		if (!device.UseGeometry()) RasterizeMisses(device, drawData);
+		device.PreparedDrawData = drawData;
 
-						// Actually, since we render a whole bunch of rectangles, we try to first detect those, and render them more efficiently.
-						// How are rectangles detected? It's actually pretty simple: If all 6 vertices lie on the extremes of the bounding box,
-						// it's a rectangle.
-						if (i + 6 <= drawCommand->ElemCount)
-						{
-							const ImDrawVert& v3 = vertexBuffer[indexBuffer[i + 3]];
-							const ImDrawVert& v4 = vertexBuffer[indexBuffer[i + 4]];
-							const ImDrawVert& v5 = vertexBuffer[indexBuffer[i + 5]];
-
-							const bool isUniformColor = isTriangleUniformColor && v2.col == v3.col && v3.col == v4.col && v4.col == v5.col;
-
-							if (isUniformColor
-							&& bounding.IsOnExtreme(v0.pos)
-							&& bounding.IsOnExtreme(v1.pos)
-							&& bounding.IsOnExtreme(v2.pos)
-							&& bounding.IsOnExtreme(v3.pos)
-							&& bounding.IsOnExtreme(v4.pos)
-							&& bounding.IsOnExtreme(v5.pos))
-							{
-								// ImGui gives the triangles in a nice order: the first vertex happens to be the topleft corner of our rectangle.
-								// We need to check for the orientation of the texture, as I believe in theory ImGui could feed us a flipped texture,
-								// so that the larger texture coordinates are at topleft instead of bottomright.
-								// We don't consider equal texture coordinates to require a flip, as then the rectangle is mostlikely simply a colored rectangle.
-								const bool doHorizontalFlip = v2.uv.x < v0.uv.x;
-								const bool doVerticalFlip = v2.uv.x < v0.uv.x;
-
-								if (isWrappedTexture)
-								{
-									DrawRectangle(bounding, static_cast<const Texture*>(drawCommand->TextureId), Color(v0.col), doHorizontalFlip, doVerticalFlip);
-								}
-								else
-								{
-									DrawRectangle(bounding, static_cast<SDL_Texture*>(drawCommand->TextureId), Color(v0.col), doHorizontalFlip, doVerticalFlip);
-								}
-
-								i += 3;  // Additional increment to account for the extra 3 vertices we consumed.
-								continue;
-							}
-						}
+		device.Stats.TotalTime += MillisecondsSince(startTime);
+	}
 
-						if (isTriangleUniformColor && doesTriangleUseOnlyColor)
-						{
-							DrawUniformColorTriangle(v0, v1, v2);
-						}
-						else
-						{
-							// Currently we assume that any non rectangular texture samples the font texture. Dunno if that's what actually happens, but it seems to work.
-							assert(isWrappedTexture);
-							DrawTriangle(v0, v1, v2, static_cast<const Texture*>(drawCommand->TextureId));
-						}
-					}
-				}
+	void Render(Context* context, ImDrawData* drawData)
+	{
+		IMGUI_SDL_TRACE_FRAME();
+		IMGUI_SDL_TRACE_ZONE("Render", "lists", drawData->CmdListsCount);
+		Device& device = *context;
+		const Uint64 startTime = SDL_GetPerformanceCounter();
 
-				indexBuffer += drawCommand->ElemCount;
-			}
+		// A Prepare that sampled the font before it was reloaded planned with the old one, so it doesn't count.
+		if (device.ReloadFontIfRebuilt()) device.PreparedDrawData = nullptr;
+
+		// Without a Prepare, the prepass only pays off when there are threads to spread it over. With a single thread the misses are simply
+		// rasterized as they come up during drawing.
+		if (device.PreparedDrawData != drawData)
+		{
+			StartFrameStats(device);
+			device.JobCount = 0;
+			PlanDrawLists(device, drawData);
+			if (device.Workers.GetThreadCount() > 1 && !device.UseGeometry()) RasterizeMisses(device, drawData);
 		}
+		device.PreparedDrawData = nullptr;
 
-		CurrentDevice->DisableClip();
+		// Whatever the application did to the renderer since the last frame, we start from what it actually is now.
+		device.State.Forget();
+		const RenderState::Snapshot initialState = device.State.Capture();
+		device.State.SetBlendMode(SDL_BLENDMODE_BLEND);
 
-		SDL_SetRenderTarget(CurrentDevice->Renderer, initialRenderTarget);
+		device.Frame++;
 
-		SDL_RenderSetClipRect(CurrentDevice->Renderer, initialClipEnabled ? &initialClipRect : nullptr);
+		UploadRasterizedMisses(device);
 
-		SDL_SetRenderDrawColor(CurrentDevice->Renderer,
-			initialR, initialG, initialB, initialA);
+		for (int n = 0; n < drawData->CmdListsCount; n++)
+		{
+			// The index of the list is the order ImGui drew the windows in, which is what ties a zone of the timeline to a window.
+			IMGUI_SDL_TRACE_ZONE("Draw list", "list", n);
+			const ImDrawList* commandList = drawData->CmdLists[n];
+			const DrawListPlan& plan = device.DrawListPlans[n];
+
+			PrimitiveStream& stream = device.PrimitiveStreams[n];
+
+			SubmissionTimer timer(device.Stats);
+			if (plan.Retained && DrawRetainedDrawList(device, commandList, stream, plan, initialState.Target)) continue;
+			DrawCommands(device, commandList, stream, commandList->VtxBuffer.Data, 0, 0);
+		}
+
+		device.State.Restore(initialState);
+		ReleaseUnusedDrawLists(device);
+		device.Atlas.Trim();
+
+		FinishFrameStats(device, startTime);
+		if (device.Configuration.AdaptiveCacheBudgets) AdaptCacheBudgets(device);
+	}
+
+	void Render(Context* context, ImDrawData* drawData, const Framebuffer& framebuffer)
+	{
+		IMGUI_SDL_TRACE_FRAME();
+		IMGUI_SDL_TRACE_ZONE("Render into framebuffer", "lists", drawData->CmdListsCount);
+		Device& device = *context;
+		const Uint64 startTime = SDL_GetPerformanceCounter();
+
+		// Whatever Prepare did was for drawing with the renderer, and none of it is of use here.
+		device.ReloadFontIfRebuilt();
+		StartFrameStats(device);
+		device.JobCount = 0;
+		device.PreparedDrawData = nullptr;
+		ResetPrimitiveStreams(device, drawData->CmdListsCount);
+
+		device.Frame++;
+
+		FramebufferTarget target(framebuffer);
+		for (int n = 0; n < drawData->CmdListsCount; n++)
+		{
+			IMGUI_SDL_TRACE_ZONE("Draw list", "list", n);
+			SubmissionTimer timer(device.Stats);
+			DrawCommandsInto(device, target, drawData->CmdLists[n], device.PrimitiveStreams[n]);
+		}
 
-		SDL_SetRenderDrawBlendMode(CurrentDevice->Renderer, blendMode);
+		FinishFrameStats(device, startTime);
 	}
 }
@@ -1,6 +1,9 @@
 ﻿#pragma once
 
+#include <cstddef>
+
 struct ImDrawData;
+struct ImFontAtlas;
 struct SDL_Renderer;
 
 namespace ImGuiSDL
@@ -14,4 +17,203 @@ namespace ImGuiSDL
 	// Call this every frame after ImGui::Render with ImGui::GetDrawData(). This will use the SDL_Renderer provided to the interfrace with Initialize
 	// to draw the contents of the draw data to the screen.
 	void Render(ImDrawData* drawData);
+
+	// Selects how the draw data is turned into SDL draw calls.
+	enum class RenderMode
+	{
+		// Sends the vertices straight to SDL_RenderGeometry if the SDL library that is loaded at runtime has it (2.0.18 and newer),
+		// and uses the rectangle drawer and the cached software rasterizer otherwise. This is the default.
+		Automatic,
+		// Asks for SDL_RenderGeometry explicitly. The rasterizer is still used if it turns out not to be available.
+		Geometry,
+		// Always uses the rectangle drawer and the cached software rasterizer, even when SDL_RenderGeometry is available.
+		Rasterizer
+	};
+
+	// Everything about the renderer that can be tuned. The defaults are what Initialize without options uses.
+	struct Options
+	{
+		// How the draw data is turned into SDL draw calls. See RenderMode.
+		RenderMode Mode = RenderMode::Automatic;
+
+		// The number of threads that rasterize the triangles that miss the cache. With a count of 1 the misses are rasterized on the calling
+		// thread as they come up. With more, Render first collects all of the misses of the frame, rasterizes them in parallel and then
+		// draws everything in the original order. 0 uses one thread per CPU core.
+		int RasterizerThreadCount = 1;
+
+		// How much texture memory each of the caches of rasterized triangles may use, in bytes. Every cached pixel takes 4 bytes. The atlas
+		// the triangles are packed into is capped at the sum of the three, so this is also the most texture memory the rasterizer uses.
+		std::size_t UniformColorTriangleCacheBytes = 4 << 20;
+		std::size_t GenericTriangleCacheBytes = 4 << 20;
+		std::size_t PolygonCacheBytes = 8 << 20;
+
+		// Lets the caches trade memory with each other. Every 60 frames, the caches that didn't have to evict anything shrink towards what
+		// they actually use, and the ones that did grow into the freed memory in proportion to their misses. The total never goes above
+		// the sum of the budgets above.
+		bool AdaptiveCacheBudgets = false;
+
+		// Uniform color triangles with a bounding box of at least this many pixels aren't cached, since a triangle that covers half of the
+		// window would take just as big a part of the atlas and push out lots of smaller triangles. They are filled row by row with
+		// rectangles instead, and rows that cover the same pixels as the one above them are merged into one rectangle.
+		int SpanFillArea = 256 * 256;
+
+		// Lets the rasterizer change the order of the draws within a draw command, so that the ones with the same texture and color get
+		// submitted together. A draw is only moved ahead of others that it doesn't overlap, so the result looks exactly the same. This mostly
+		// helps with text in many colors and with lots of small widgets, but the sorting costs a little time of its own.
+		bool ReorderDraws = false;
+
+		// Draws every draw list into a texture of its own, and as long as a list stays the same from one frame to the next, only copies that
+		// texture to the screen instead of drawing the list again. A list that has only moved by whole pixels, like a window that is being
+		// dragged, counts as the same. Whether a list changed is found out by hashing its vertices, indices and commands. Lists with user
+		// callbacks or textures other than the font are always drawn directly, since what they draw can change without the list changing,
+		// and building the font atlas again has every list drawn again. Lists too big for a texture of the renderer are drawn directly too.
+		// The textures hold premultiplied colors, so the result can be off by a shade from drawing directly. This needs render targets and
+		// custom blend modes, and turns itself off on renderers that don't have them, like the software renderer.
+		bool RetainDrawLists = false;
+
+		// A file to keep the rasterized triangles in between runs, so that the first frames don't have to rasterize everything again. Null
+		// turns this off, which is the default. The file is memory mapped when the options are applied, and the triangles in it are uploaded
+		// the first time they are drawn instead of being rasterized. It's written when the context is destroyed or switches to another file,
+		// with as many of the cached triangles as the cache budgets above allow. Files written by another version of ImGuiSDL or for another
+		// font atlas are ignored and overwritten. The path is copied, and keeping the pixels around for writing them costs as much memory
+		// as the atlas takes texture memory.
+		const char* CacheFilePath = nullptr;
+
+		// The most pixels that may be rasterized in a single frame for the triangles that missed the caches, or 0 for no limit, which is the
+		// default. Opening a big window can miss the caches with thousands of triangles at once, and this keeps such a frame from taking
+		// much longer than the others. Once the budget is used up, the rest of the misses are drawn as stand-ins: their shape filled with the
+		// average color of their vertices, which is exact for uniform color triangles and only loses the gradient and the texture of the
+		// rest. They get rasterized over the following frames as the budget allows, and FrameStats::IsConverging tells whether that's still
+		// going on. The budget is in pixels instead of time so that what gets drawn doesn't depend on how busy the machine is. Drawing into a
+		// framebuffer isn't limited, as there's no cache there to catch up with.
+		long long RasterizationBudget = 0;
+	};
+
+	// Same as the other Initialize, but with options other than the defaults.
+	void Initialize(SDL_Renderer* renderer, int windowWidth, int windowHeight, const Options& options);
+
+	// Call this after Initialize to change the options. Caches that are now over their budget evict entries right away.
+	void SetOptions(const Options& options);
+	const Options& GetOptions();
+
+	// Call this after Initialize to change just the render mode. This is mostly useful for comparing the two paths against each other.
+	// Returns false if Geometry was requested but SDL_RenderGeometry isn't available.
+	bool SetRenderMode(RenderMode mode);
+
+	// Call this after Initialize to change just the number of rasterizer threads. See Options::RasterizerThreadCount.
+	void SetRasterizerThreadCount(int count);
+
+	// What happened during a single call to Render. Times are in milliseconds.
+	struct FrameStats
+	{
+		// The lookups into one of the triangle caches, and how full the cache was at the end of the frame.
+		struct CacheStats
+		{
+			int Hits = 0, Misses = 0, Evictions = 0;
+			int Entries = 0;
+			long long UsedBytes = 0, BudgetBytes = 0;
+		};
+
+		// How the triangles were drawn. Rectangles are the quads that took the fast path of a single fill or copy, gradient rectangles are
+		// the quads with colors changing across them that were stretched from a tiny texture, span triangles are the big uniform color
+		// triangles that were filled row by row (see Options::SpanFillArea), and geometry commands are whole draw commands that were handed
+		// to SDL_RenderGeometry.
+		int Rectangles = 0, GradientRectangles = 0, Polygons = 0, UniformColorTriangles = 0, SpanTriangles = 0, GenericTriangles = 0, GeometryCommands = 0;
+
+		// The draw commands and triangles that were skipped because they were entirely outside of their clip rect or of the screen, and the
+		// big triangles that were mostly outside, so that only their visible part was rasterized and they weren't cached. Culled rectangles
+		// and polygons count as the triangles they're made of.
+		int CulledCommands = 0, CulledTriangles = 0, ClippedTriangles = 0;
+
+		// The triangles and polygons that were over the rasterization budget and were drawn as stand-ins instead, and whether there were any.
+		// While the UI is converging, the following frames still have rasterizing to catch up on. See Options::RasterizationBudget. The
+		// averaged stats say whether the last frame was converging.
+		int StandIns = 0;
+		bool IsConverging = false;
+
+		CacheStats UniformColorTriangleCache, GenericTriangleCache, PolygonCache;
+
+		// The draw lists that were copied from their retained texture (hits) and the ones that had to be drawn into it again (misses). The
+		// budget is always 0, as the retained textures aren't limited by anything but the number of lists. See Options::RetainDrawLists.
+		CacheStats DrawListCache;
+
+		// The triangles that missed the caches but were found in the cache file, so they only had to be uploaded. See Options::CacheFilePath.
+		int CacheFileHits = 0;
+
+		// The number of atlas pages the cached triangles live in, and how many of them had to be cleared to make room for new ones.
+		int AtlasPages = 0, AtlasEvictions = 0;
+
+		// The area of the bounding boxes of everything that was rasterized. Triangles that were loaded from the cache file were only uploaded,
+		// so they count as CacheFileHits instead.
+		long long RasterizedPixels = 0;
+
+		// Calls into the SDL renderer for drawing, changing state and uploading textures, and the state changes that were skipped because
+		// the renderer already was in that state.
+		int SDLCalls = 0, ElidedSDLCalls = 0;
+
+		// Classification is sorting the triangles of the draw lists out into rectangles, polygons and the like, which is done once for every
+		// list that isn't copied from its retained texture. Submission is whatever else went into drawing the lists: walking the sorted out
+		// triangles, culling them, looking them up from the caches and handing them to SDL. It's timed for whole lists, as timing every SDL
+		// call would cost more than many of the calls do. Drawing is whatever isn't one of the others, like planning the frame.
+		double ClassificationTime = 0.0, DrawingTime = 0.0, RasterizationTime = 0.0, UploadTime = 0.0, SubmissionTime = 0.0, TotalTime = 0.0;
+	};
+
+	// Returns the stats of the frame that was rendered last.
+	const FrameStats& GetFrameStats();
+	// Returns the stats averaged over the last 60 rendered frames, which are a lot steadier than the ones of a single frame.
+	FrameStats GetAverageFrameStats();
+	// Draws the averaged stats into an ImGui window. Call this between ImGui::NewFrame and ImGui::Render like any other window.
+	void ShowStatsWindow(bool* open = nullptr);
+
+	// Records what Render and Prepare spend their time on, down to the single cache lookups and rasterized triangles, as a timeline that
+	// can be opened in Perfetto or chrome://tracing. Each thread records into a buffer of its own that keeps its last 65536 zones, so only
+	// the end of a long recording is kept. This covers all contexts, but only works when imgui_sdl.cpp is compiled with IMGUI_SDL_TRACE
+	// defined to 1. Otherwise the recording isn't compiled in at all, and these do nothing. Call them between frames.
+	void StartTrace();
+	void StopTrace();
+	// Writes what was recorded as Chrome trace event JSON. Call this after StopTrace, while no context is rendering or preparing a frame on
+	// any thread. Returns false if the trace is still being recorded, the file couldn't be written or tracing isn't compiled in.
+	bool WriteTrace(const char* path);
+
+	// Everything above works on the one renderer that Initialize sets up. To draw with more than one renderer, or from more than one ImGui
+	// context, create a context for each of them instead. A context has its own caches, rasterizer threads and copy of the font texture,
+	// and nothing is shared between contexts. The functions above work on the context that Initialize creates.
+	struct Context;
+
+	// Creates a context that draws with the given renderer. The font texture is made from the given atlas, which is usually
+	// ImGui::GetIO().Fonts. If the atlas doesn't have a TexID yet, it gets one that stands for the font texture of this context. Other
+	// contexts that share the atlas recognize the font by that TexID, so destroy the context that set it last. Unlike Initialize, this
+	// doesn't touch the IO or the style of ImGui. The renderer may be null for a context that only ever draws into framebuffers.
+	Context* CreateContext(SDL_Renderer* renderer, ImFontAtlas* fonts, const Options& options = Options());
+	void DestroyContext(Context* context);
+
+	// Does the CPU side of rendering the draw data ahead of time: sorting out the triangles and rasterizing the ones that aren't cached yet.
+	// This doesn't use the SDL renderer or ImGui at all, so it can be called from any thread, and different contexts can be prepared on
+	// different threads at the same time. The draw data must stay as it is until it has been rendered. Calling this is optional, as Render
+	// does the same work itself when it wasn't.
+	void Prepare(Context* context, ImDrawData* drawData);
+	// Draws the draw data with the renderer of the context. Call this on the thread the renderer belongs to, and never at the same time as
+	// Prepare for the same context.
+	void Render(Context* context, ImDrawData* drawData);
+
+	// Memory to draw into instead of an SDL renderer. Every pixel is 32 bits with red in the lowest byte, the same layout as ImU32 and
+	// SDL_PIXELFORMAT_RGBA32. Pitch is the distance from the start of one row to the next in bytes.
+	struct Framebuffer
+	{
+		void* Pixels = nullptr;
+		int Pitch = 0;
+		int Width = 0, Height = 0;
+	};
+
+	// Draws the draw data into the framebuffer on the CPU, without a single call to the renderer of the context, so this can run on any
+	// thread and with a context that has no renderer at all. The framebuffer isn't cleared first. Triangles are rasterized every frame, as
+	// the caches only hold textures of the renderer, and draw commands with textures other than the font are skipped. The render mode,
+	// the rasterizer threads, Prepare and the retained draw lists don't apply here.
+	void Render(Context* context, ImDrawData* drawData, const Framebuffer& framebuffer);
+
+	void SetOptions(Context* context, const Options& options);
+	const Options& GetOptions(Context* context);
+	const FrameStats& GetFrameStats(Context* context);
+	FrameStats GetAverageFrameStats(Context* context);
+	void ShowStatsWindow(Context* context, bool* open = nullptr);
 }